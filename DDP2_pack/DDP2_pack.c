@@ -7,286 +7,160 @@ made by Darkness-TX
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <io.h>
-#include <direct.h>
 #include <Windows.h>
 #include <locale.h>
-
-typedef unsigned char  unit8;
-typedef unsigned short unit16;
-typedef unsigned int   unit32;
+#include "ddp.h"
 
 unit32 FileNum = 0;//总文件数，初始计数为0
+int Compact = 0;//-compact：去掉-patch留下的废弃数据
+char *Layout = NULL;//-layout：type、name或ddp layout写出的布局文件
+int StatsOn = 0;//--stats：统计各阶段的耗时
+char *TracePath = NULL;//--trace：同时写出Chrome trace格式的事件
 
-struct dheader
-{
-	unit8 magic[4];//DDP2
-	unit32 num;
-	unit32 file_offset;
-	unit32 filesize;//文件最后4字节
-}dat_header;
-
-struct hheader
-{
-	unit8 magic[8];// DDWuHXB或者DDSxHXB
-	unit8 length[3];
-	unit8 flag;
-	unit32 unk;// 0
-}hxb_header;
-
-struct index
+//ddp_pack_archive每写出一个条目回调一次，在调用线程中按存放的顺序调用
+void PackDone(void *ctx, unit32 i, const struct ddp_entry *e, int kept)
 {
-	unit32 offset;
-	unit32 uncomprlen;
-	unit32 comprlen;
-}Index[7000];
+	printf("\t%08d comprlen:0x%X uncomprlen:0x%X offset:0x%X%s\n", i, e->comprlen, e->uncomprlen, e->offset, kept ? " 未改动" : "");
+	FileNum++;
+}
 
-void ddp_uncompress(unit8 *uncompr, unit32 uncomprlen, unit8 *compr, unit32 comprlen)
+void PrintStats(ddp_stats *stats)
 {
-	unit32 curbyte = 0, i;
-	unit32 act_uncomprlen = 0;
-	while (act_uncomprlen < uncomprlen)
+	if (stats == NULL)
+		return;
+	ddp_stats_print(stats, stdout);
+	if (TracePath != NULL)
 	{
-		unit8 flag = compr[curbyte++];
-		unit32 offset, copy_len;
-
-		if (flag < 0x1D)
-		{
-			copy_len = flag + 1;
-			offset = 0;
-		}
-		else if (flag == 0x1D)
-		{
-			copy_len = compr[curbyte++] + 0x1E;
-			offset = 0;
-		}
-		else if (flag == 0x1E)
-		{
-			copy_len = ((compr[curbyte] << 8) | compr[curbyte + 1]) + 0x11E;
-			curbyte += 2;
-			offset = 0;
-		}
-		else if (flag == 0x1F)
-		{
-			copy_len = (compr[curbyte] << 24) | (compr[curbyte + 1] << 16)
-				| (compr[curbyte + 2] << 8) | compr[curbyte + 3];
-			curbyte += 4;
-			offset = 0;
-		}
+		if (ddp_stats_write_trace(stats, TracePath) == DDP_OK)
+			printf("trace已写入%s\n", TracePath);
 		else
-		{
-			if (flag < 0x80)
-			{
-				if ((flag & 0x60) == 0x20)
-				{
-					copy_len = flag & 3;
-					offset = (flag >> 2) & 7;
-				}
-				else if ((flag & 0x60) == 0x40)
-				{
-					copy_len = (flag & 0x1f) + 4;
-					offset = compr[curbyte++];
-				}
-				else
-				{
-					offset = ((flag & 0x1F) << 8) | compr[curbyte++];
-					flag = compr[curbyte++];
-					switch (flag)
-					{
-					case 0xFE:
-						copy_len = ((compr[curbyte] << 8) | compr[curbyte + 1]) + 0x102;
-						curbyte += 2;
-						break;
-					case 0xFF:
-						copy_len = (compr[curbyte] << 24) | (compr[curbyte + 1] << 16) | (compr[curbyte + 2] << 8) | compr[curbyte + 3];
-						curbyte += 4;
-						break;
-					default:
-						copy_len = flag + 4;
-					}
-				}
-			}
-			else
-			{
-				copy_len = (flag >> 5) & 3;
-				offset = ((flag & 0x1F) << 8) | compr[curbyte++];
-			}
-			offset++;
-			copy_len += 3;
-		}
-
-		if (offset)
-		{
-			for (i = 0; i < copy_len; i++)
-			{
-				uncompr[act_uncomprlen] = uncompr[act_uncomprlen - offset];
-				act_uncomprlen++;
-			}
-		}
-		else
-		{
-			for (i = 0; i < copy_len; i++)
-				uncompr[act_uncomprlen++] = compr[curbyte++];
-		}
+			printf("%s: %s!。\n", TracePath, ddp_strerror(DDP_ERR_WRITE));
 	}
+	ddp_stats_free(stats);
 }
 
-void hxb_encrypt(unit8 *data)
+//按<dat>_unpack中的文件和原封包的索引打包为<dat>_new，-patch时直接修改原封包，读入、压缩和写出都由libddp完成
+void PackFile(char *fname, struct ddp_pack_params *params)
 {
-	int seed = hxb_header.length[0] << 16 | hxb_header.length[1] << 8 | hxb_header.length[2];
-	int key = (((seed << 5) ^ 0xA5) * (seed + 0x6F349)) ^ 0x34A9B129;
-	unit32 *p = (unit32 *)(data + 0x10);
-	for (int i = 0; i < (seed - 13) / 4; i++)
-		p[i] ^= key;
-}
-
-void PackFile(char *fname)
-{
-	FILE *src, *packdst, *dst;
-	unit8 dstname[200], *cdata, *udata;
-	unit32 i = 0;
-	src = fopen(fname, "rb");
-	fread(dat_header.magic, 4, 1, src);
-	if (strncmp(dat_header.magic, "DDP2", 4) != 0)
+	ddp_archive *ar;
+	const struct ddp_header *header;
+	char dstname[MAX_PATH];
+	unit32 *order = NULL;
+	int err;
+	ar = ddp_open(fname, &err);
+	if (ar == NULL || ddp_archive_format(ar) != DDP_FORMAT_DDP2)
 	{
-		printf("文件头不是DDP2!。\n");
+		printf("%s!。\n", ar == NULL ? ddp_strerror(err) : "文件头不是DDP2");
 		system("pause");
 		exit(0);
 	}
-	sprintf(dstname, "%s_new", fname);
-	packdst = fopen(dstname, "wb");
-	sprintf(dstname, "%s_unpack", fname);
-	fread(&dat_header.num, 1, 4, src);
-	fread(&dat_header.file_offset, 4, 1, src);
-	fseek(src, -4, SEEK_END);
-	fread(&dat_header.filesize, 4, 1, src);
-	udata = malloc(dat_header.file_offset);
-	fseek(src, 0, SEEK_SET);
-	fread(udata, dat_header.file_offset, 1, src);
-	fwrite(udata, dat_header.file_offset, 1, packdst);
-	free(udata);
-	fseek(src, 0x20, SEEK_SET);
-	for (i = 0; i < dat_header.num; i++)
-	{
-		fread(&Index[i], 0xC, 1, src);
-		fseek(src, 4, SEEK_CUR);
-	}
-	_chdir(dstname);
-	for (i = 0; i < dat_header.num; i++)
+	header = ddp_archive_header(ar);
+	if (Layout != NULL && !params->patch)
 	{
-		fseek(src, Index[i].offset, SEEK_SET);
-		udata = malloc(Index[i].uncomprlen);
-		if (Index[i].comprlen != 0)
-		{
-			cdata = malloc(Index[i].comprlen);
-			fread(cdata, Index[i].comprlen, 1, src);
-			ddp_uncompress(udata, Index[i].uncomprlen, cdata, Index[i].comprlen);
-			free(cdata);
-		}
-		else
-			fread(udata, Index[i].uncomprlen, 1, src);
-		if (udata[0] == 'D' && udata[1] == 'D' && udata[4] == 'H' && udata[5] == 'X' && udata[6] == 'B')//DDWuHXB，似乎还有种DDSxHXB
-		{
-			free(udata);
-			sprintf(dstname, "%08d.hxb", i);
-			dst = fopen(dstname, "rb");
-			fseek(dst, 0, SEEK_END);
-			Index[i].uncomprlen = ftell(dst);
-			Index[i].comprlen = 0;
-			Index[i].offset = ftell(packdst);
-			fseek(dst, 0, SEEK_SET);
-			udata = malloc(Index[i].uncomprlen);
-			fread(udata, Index[i].uncomprlen, 1, dst);
-			memcpy(&hxb_header, udata, 0x10);
-			hxb_encrypt(udata);
-			fwrite(udata, Index[i].uncomprlen, 1, packdst);
-			free(udata);
-		}
-		else if (udata[0] == 'B' && udata[1] == 'M')
-		{
-			free(udata);
-			sprintf(dstname, "%08d.bmp", i);
-			dst = fopen(dstname, "rb");
-			fseek(dst, 0, SEEK_END);
-			Index[i].uncomprlen = ftell(dst);
-			Index[i].comprlen = 0;
-			Index[i].offset = ftell(packdst);
-			fseek(dst, 0, SEEK_SET);
-			udata = malloc(Index[i].uncomprlen);
-			fread(udata, Index[i].uncomprlen, 1, dst);
-			fwrite(udata, Index[i].uncomprlen, 1, packdst);
-			free(udata);
-		}
-		else if (udata[0] == 0x89 && udata[1] == 0x50 && udata[2] == 0x4E && udata[3] == 0x47)
-		{
-			free(udata);
-			sprintf(dstname, "%08d.png", i);
-			dst = fopen(dstname, "rb");
-			fseek(dst, 0, SEEK_END);
-			Index[i].uncomprlen = ftell(dst);
-			Index[i].comprlen = 0;
-			Index[i].offset = ftell(packdst);
-			fseek(dst, 0, SEEK_SET);
-			udata = malloc(Index[i].uncomprlen);
-			fread(udata, Index[i].uncomprlen, 1, dst);
-			fwrite(udata, Index[i].uncomprlen, 1, packdst);
-			free(udata);
-		}
-		else if (udata[0] == 0 && udata[1] == 0 && (udata[2] == 0x0A || udata[2] == 0x02))
-		{
-			free(udata);
-			sprintf(dstname, "%08d.tga", i);
-			dst = fopen(dstname, "rb");
-			fseek(dst, 0, SEEK_END);
-			Index[i].uncomprlen = ftell(dst);
-			Index[i].comprlen = 0;
-			Index[i].offset = ftell(packdst);
-			fseek(dst, 0, SEEK_SET);
-			udata = malloc(Index[i].uncomprlen);
-			fread(udata, Index[i].uncomprlen, 1, dst);
-			fwrite(udata, Index[i].uncomprlen, 1, packdst);
-			free(udata);
-		}
+		if (strcmp(Layout, "type") == 0 || strcmp(Layout, "name") == 0)
+			order = ddp_layout_guess(ar, strcmp(Layout, "type") == 0 ? DDP_LAYOUT_TYPE : DDP_LAYOUT_NAME);
 		else
+			order = ddp_layout_read(Layout, ar);
+		if (order == NULL)
 		{
-			free(udata);
-			sprintf(dstname, "%08d.bin", i);
-			dst = fopen(dstname, "rb");
-			fseek(dst, 0, SEEK_END);
-			Index[i].uncomprlen = ftell(dst);
-			Index[i].comprlen = 0;
-			Index[i].offset = ftell(packdst);
-			fseek(dst, 0, SEEK_SET);
-			udata = malloc(Index[i].uncomprlen);
-			fread(udata, Index[i].uncomprlen, 1, dst);
-			fwrite(udata, Index[i].uncomprlen, 1, packdst);
-			free(udata);
+			printf("%s: 布局文件不存在或与封包不符!。\n", Layout);
+			ddp_close(ar);
+			return;
 		}
-		fclose(dst);
-		printf("\t%s comprlen:0x%X uncomprlen:0x%X offset:0x%X\n", dstname, Index[i].comprlen, Index[i].uncomprlen, Index[i].offset);
-		FileNum++;
+		params->order = order;
 	}
-	fclose(src);
-	fseek(packdst, 0x20, SEEK_SET);
-	for (i = 0; i < dat_header.num; i++)
+	sprintf(dstname, params->patch ? "%s" : "%s_new", fname);
+	params->done = PackDone;
+	if (StatsOn)
+		params->stats = ddp_stats_create(ddp_entry_count(ar), TracePath != NULL);
+	err = ddp_pack_archive(ar, fname, NULL, dstname, params);
+	if (!params->has_manifest)
+		printf("没有找到有效的清单%s，已读取原条目判断类型\n", DDP_MANIFEST_NAME);
+	if (err == DDP_ERR_PATCH)
+		printf("-patch需要解包时写出的清单%s!。\n", DDP_MANIFEST_NAME);
+	else if (err != DDP_OK && params->missing != DDP_NOT_FOUND)
+		printf("\t%08d 打开失败!。\n", params->missing);
+	else if (err != DDP_OK)
+		printf("%s!。\n", ddp_strerror(err));
+	else
 	{
-		fwrite(&Index[i], 0xC, 1, packdst);
-		fseek(packdst, 4, SEEK_CUR);
+		printf("%s num:%d data_offset:0x%X file_size:0x%X\n", dstname, header->num, header->file_offset, params->filesize);
+		if (params->dedup && !params->patch)
+			printf("相同的条目共用数据区，省下0x%X字节\n", params->saved);
 	}
-	fseek(packdst, 0, SEEK_END);
-	dat_header.filesize = ftell(packdst) + 4;
-	fwrite(&dat_header.filesize, 1, 4, packdst);
-	sprintf(dstname, "%s_new", fname);
-	printf("%s num:%d data_offset:0x%X file_size:0x%X\n", dstname, dat_header.num, dat_header.file_offset, dat_header.filesize);
-	fclose(packdst);
+	free(order);
+	ddp_close(ar);
+	PrintStats(params->stats);
+}
+
+//去掉-patch留下的废弃数据，清单中的封包大小随之更新
+void CompactFile(char *fname)
+{
+	unit32 saved;
+	int err = ddp_pack_compact(fname, NULL, &saved);
+	if (err != DDP_OK)
+		printf("%s!。\n", ddp_strerror(err));
+	else
+		printf("%s 整理完成，回收了0x%X字节\n", fname, saved);
 }
 
 int main(int argc, char *argv[])
 {
+	char *fname = NULL;
+	struct ddp_pack_params params;
+	SYSTEM_INFO info;
+	int i;
 	setlocale(LC_ALL, "chs");
-	printf("project：Niflheim-三国恋战记\n用于封包文件头为DDP2的dat文件。\n将dat文件拖到程序上。\nby Darkness-TX 2018.01.18\n\n");
-	PackFile(argv[1]);
-	printf("已完成，总文件数%d\n", FileNum);
+	printf("project：Niflheim-三国恋战记\n用于封包文件头为DDP2的dat文件。\n将dat文件拖到程序上。\n可选参数-store/-fast/-lazy/-optimal指定压缩等级，默认-lazy。\n可选参数-inc只重新压缩解包后改动过的文件。\n可选参数-patch把改动过的文件追加到原dat末尾，就地更新索引。\n可选参数-compact去掉-patch留下的废弃数据。\n可选参数-dedup让内容相同的条目共用同一块数据。\n可选参数-layout type|name|布局文件指定数据的存放顺序。\n可选参数-j N指定压缩线程数，0为CPU核心数，默认1；输出与线程数无关。\n可选参数--stats统计各阶段的耗时，--trace out.json同时写出Chrome trace。\nby Darkness-TX 2018.01.18\n\n");
+	memset(&params, 0, sizeof(params));
+	params.level = DDP_LEVEL_LAZY;
+	params.threads = 1;
+	for (i = 1; i < argc; i++)
+	{
+		if (strcmp(argv[i], "-store") == 0)
+			params.level = DDP_LEVEL_STORE;
+		else if (strcmp(argv[i], "-fast") == 0)
+			params.level = DDP_LEVEL_FAST;
+		else if (strcmp(argv[i], "-lazy") == 0)
+			params.level = DDP_LEVEL_LAZY;
+		else if (strcmp(argv[i], "-optimal") == 0)
+			params.level = DDP_LEVEL_OPTIMAL;
+		else if (strcmp(argv[i], "-inc") == 0)
+			params.incremental = 1;
+		else if (strcmp(argv[i], "-patch") == 0)
+			params.patch = 1;
+		else if (strcmp(argv[i], "-compact") == 0)
+			Compact = 1;
+		else if (strcmp(argv[i], "-dedup") == 0)
+			params.dedup = 1;
+		else if (strcmp(argv[i], "-layout") == 0 && i + 1 < argc)
+			Layout = argv[++i];
+		else if (strcmp(argv[i], "-j") == 0 && i + 1 < argc)
+		{
+			params.threads = atoi(argv[++i]);
+			if (params.threads == 0)
+			{
+				GetSystemInfo(&info);
+				params.threads = info.dwNumberOfProcessors;
+			}
+		}
+		else if (strcmp(argv[i], "--stats") == 0)
+			StatsOn = 1;
+		else if (strcmp(argv[i], "--trace") == 0 && i + 1 < argc)
+		{
+			StatsOn = 1;
+			TracePath = argv[++i];
+		}
+		else if (fname == NULL)
+			fname = argv[i];
+	}
+	if (Compact)
+		CompactFile(fname);
+	else
+	{
+		PackFile(fname, &params);
+		printf("已完成，总文件数%d，其中%d个未改动\n", FileNum, params.kept);
+	}
 	system("pause");
 	return 0;
-}
\ No newline at end of file
+}
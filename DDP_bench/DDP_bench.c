@@ -0,0 +1,653 @@
+/*
+测试dat文件中压缩条目的解压速度，对比逐字节的参考实现、优化后的ddp_uncompress和带边界检查的ddp_uncompress_safe
+三者的输出会先逐条目校验是否一致
+-gen时不需要游戏数据：生成合成的DDP2和DDP3封包，测量打包、解包的耗时，按条目大小分档的解压速度，
+平均每个条目的内存分配次数和峰值内存，可以用-o把结果写成JSON，便于比较不同的版本
+*/
+#define _CRT_SECURE_NO_WARNINGS
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#ifdef _WIN32
+#include <Windows.h>
+#include <psapi.h>
+#pragma comment(lib, "psapi.lib")
+#else
+#include <time.h>
+#include <sys/resource.h>
+#endif
+#include "ddp.h"
+
+//统计内存分配次数：glibc下替换malloc系列函数，MSVC的Debug版用分配钩子，其他情况不统计
+//AddressSanitizer自己替换了malloc，不能再替换
+volatile long AllocCount = 0;
+#if defined(__GLIBC__) && !defined(__SANITIZE_ADDRESS__)
+#define ALLOC_COUNTED 1
+void *__libc_malloc(size_t size);
+void *__libc_calloc(size_t num, size_t size);
+void *__libc_realloc(void *p, size_t size);
+
+void *malloc(size_t size)
+{
+	__sync_fetch_and_add(&AllocCount, 1);
+	return __libc_malloc(size);
+}
+
+void *calloc(size_t num, size_t size)
+{
+	__sync_fetch_and_add(&AllocCount, 1);
+	return __libc_calloc(num, size);
+}
+
+void *realloc(void *p, size_t size)
+{
+	__sync_fetch_and_add(&AllocCount, 1);
+	return __libc_realloc(p, size);
+}
+#elif defined(_MSC_VER) && defined(_DEBUG)
+#define ALLOC_COUNTED 1
+#include <crtdbg.h>
+
+int AllocHook(int type, void *data, size_t size, int block, long request, const unsigned char *file, int line)
+{
+	if (type == _HOOK_ALLOC || type == _HOOK_REALLOC)
+		InterlockedIncrement(&AllocCount);
+	return 1;
+}
+#else
+#define ALLOC_COUNTED 0
+#endif
+
+typedef void (*uncompress_fn)(unit8 *uncompr, unit32 uncomprlen, unit8 *compr, unit32 comprlen);
+
+struct sample
+{
+	unit8 *compr;
+	unit32 comprlen;
+	unit32 uncomprlen;
+};
+
+double Now(void)
+{
+#ifdef _WIN32
+	LARGE_INTEGER freq, count;
+	QueryPerformanceFrequency(&freq);
+	QueryPerformanceCounter(&count);
+	return (double)count.QuadPart / freq.QuadPart;
+#else
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+#endif
+}
+
+void UncompressSafe(unit8 *uncompr, unit32 uncomprlen, unit8 *compr, unit32 comprlen)
+{
+	ddp_uncompress_safe(uncompr, uncomprlen, compr, comprlen);
+}
+
+double Run(uncompress_fn fn, struct sample *samples, unit32 num, unit8 *out, int rounds)
+{
+	double start = Now();
+	unit32 i;
+	int r;
+	for (r = 0; r < rounds; r++)
+		for (i = 0; i < num; i++)
+			fn(out, samples[i].uncomprlen, samples[i].compr, samples[i].comprlen);
+	return Now() - start;
+}
+
+void BenchFile(char *fname, int rounds)
+{
+	ddp_archive *ar;
+	const struct ddp_entry *e;
+	struct ddp_iter it;
+	struct sample *samples;
+	unit8 *ref, *out;
+	unit32 num = 0, i, maxlen = 0;
+	double total = 0, tref, tfast, tsafe;
+	int err;
+	ar = ddp_open(fname, &err);
+	if (ar == NULL)
+	{
+		printf("%s: %s\n", fname, ddp_strerror(err));
+		return;
+	}
+	samples = malloc((ddp_entry_count(ar) + 1) * sizeof(struct sample));
+	ddp_iter_begin(&it, ar);
+	while ((e = ddp_iter_next(&it)) != NULL)
+	{
+		if (e->comprlen == 0)
+			continue;
+		samples[num].compr = malloc(e->comprlen);
+		samples[num].comprlen = e->comprlen;
+		samples[num].uncomprlen = e->uncomprlen;
+		if (ddp_read_raw(ar, it.next - 1, samples[num].compr, e->comprlen) != DDP_OK)
+		{
+			free(samples[num].compr);
+			continue;
+		}
+		if (e->uncomprlen > maxlen)
+			maxlen = e->uncomprlen;
+		total += e->uncomprlen;
+		num++;
+	}
+	ddp_close(ar);
+	ref = malloc(maxlen + 1);
+	out = malloc(maxlen + 1);
+	for (i = 0; i < num; i++)
+	{
+		ddp_uncompress_ref(ref, samples[i].uncomprlen, samples[i].compr, samples[i].comprlen);
+		ddp_uncompress(out, samples[i].uncomprlen, samples[i].compr, samples[i].comprlen);
+		if (memcmp(ref, out, samples[i].uncomprlen) != 0
+			|| ddp_uncompress_safe(out, samples[i].uncomprlen, samples[i].compr, samples[i].comprlen) != DDP_OK
+			|| memcmp(ref, out, samples[i].uncomprlen) != 0)
+		{
+			printf("%s: 第%d个压缩条目的解压结果与参考实现不一致!\n", fname, i);
+			break;
+		}
+	}
+	if (i == num && num != 0)
+	{
+		tref = Run(ddp_uncompress_ref, samples, num, out, rounds);
+		tfast = Run(ddp_uncompress, samples, num, out, rounds);
+		tsafe = Run(UncompressSafe, samples, num, out, rounds);
+		printf("%s 压缩条目:%d 解压后:%.1fMB\n", fname, num, total / 1048576);
+		printf("\tddp_uncompress_ref %8.1f MB/s\n", total * rounds / 1048576 / tref);
+		printf("\tddp_uncompress     %8.1f MB/s (x%.2f)\n", total * rounds / 1048576 / tfast, tref / tfast);
+		printf("\tddp_uncompress_safe %7.1f MB/s (x%.2f)\n", total * rounds / 1048576 / tsafe, tref / tsafe);
+	}
+	else if (num == 0)
+		printf("%s 没有压缩的条目\n", fname);
+	for (i = 0; i < num; i++)
+		free(samples[i].compr);
+	free(samples);
+	free(ref);
+	free(out);
+}
+
+//合成封包的参数
+unit32 SynthSize = 64;//条目内容的总大小，MB
+unit32 Seed = 1;
+int CompressLevel = DDP_LEVEL_LAZY;
+unit32 Threads = 1;
+char *TempDir = ".";
+
+#define BUCKETS 4
+const char *BucketName[BUCKETS] = { "<4KB", "4KB-64KB", "64KB-1MB", ">=1MB" };
+const unit32 BucketMin[BUCKETS] = { 0x10, 4 << 10, 64 << 10, 1 << 20 };
+const unit32 BucketMax[BUCKETS] = { 4 << 10, 64 << 10, 1 << 20, 4 << 20 };
+const unit32 BucketWeight[BUCKETS] = { 70, 20, 8, 2 };//按条目数的比例，大部分是小文件
+
+struct payload
+{
+	unit8 *data;//解包后的内容，HXB未加密
+	unit32 len;
+	int type;
+};
+
+struct phase_result
+{
+	double seconds;
+	double allocs;//平均每个条目，不统计时为-1
+};
+
+struct bucket_result
+{
+	unit32 entries;//压缩的条目数
+	unit32 stored;//未压缩的条目数，不参与解压测试
+	double bytes;
+	double seconds;
+};
+
+struct synth_result
+{
+	int format;
+	unit32 archive_size;
+	int verified;//解包结果与生成的内容一致
+	struct phase_result pack, unpack;
+	struct bucket_result buckets[BUCKETS];
+	long peak_rss;//到这一项测完为止进程的峰值内存，KB
+};
+
+unit32 Rand(void)
+{
+	Seed ^= Seed << 13;
+	Seed ^= Seed >> 17;
+	Seed ^= Seed << 5;
+	return Seed;
+}
+
+int Bucket(unit32 len)
+{
+	int b = 0;
+	while (b < BUCKETS - 1 && len >= BucketMax[b])
+		b++;
+	return b;
+}
+
+long PeakRSS(void)
+{
+#ifdef _WIN32
+	PROCESS_MEMORY_COUNTERS pmc;
+	if (!GetProcessMemoryInfo(GetCurrentProcess(), &pmc, sizeof(pmc)))
+		return -1;
+	return (long)(pmc.PeakWorkingSetSize / 1024);
+#else
+	struct rusage ru;
+	if (getrusage(RUSAGE_SELF, &ru) != 0)
+		return -1;
+	return ru.ru_maxrss;
+#endif
+}
+
+double AllocsPerEntry(long count, unit32 entries)
+{
+	return ALLOC_COUNTED && entries != 0 ? (double)count / entries : -1;
+}
+
+//每64字节一段，按entropy的概率填随机数，否则复制8KB以内的前文，entropy越大越难压缩
+void Fill(unit8 *p, unit32 len, unit32 entropy)
+{
+	unit32 i, k, n, dist;
+	for (i = 0; i < len; i += n)
+	{
+		n = len - i < 64 ? len - i : 64;
+		if (i < 64 || Rand() % 100 < entropy)
+			for (k = 0; k < n; k++)
+				p[i + k] = (unit8)Rand();
+		else
+		{
+			dist = 1 + Rand() % (i < 0x2000 ? i : 0x2000);
+			for (k = 0; k < n; k++)
+				p[i + k] = p[i + k - dist];
+		}
+	}
+}
+
+//按类型生成内容，文件头能被ddp_sniff识别，压缩率随类型和随机的entropy变化
+void MakePayload(struct payload *p)
+{
+	unit8 *d = p->data;
+	unit32 len = p->len;
+	switch (p->type)
+	{
+	case DDP_TYPE_HXB:
+		Fill(d, len, 5 + Rand() % 20);
+		memcpy(d, "DDWuHXB", 8);
+		d[8] = (unit8)((len - 0x10) >> 16);
+		d[9] = (unit8)((len - 0x10) >> 8);
+		d[10] = (unit8)(len - 0x10);
+		memset(d + 11, 0, 5);
+		break;
+	case DDP_TYPE_BMP:
+		Fill(d, len, 20 + Rand() % 40);
+		d[0] = 'B';
+		d[1] = 'M';
+		break;
+	case DDP_TYPE_PNG:
+		Fill(d, len, 100);
+		memcpy(d, "\x89PNG\r\n\x1A\n", 8);
+		break;
+	case DDP_TYPE_TGA:
+		Fill(d, len, 30 + Rand() % 40);
+		d[0] = 0;
+		d[1] = 0;
+		d[2] = 2;
+		break;
+	default:
+		Fill(d, len, Rand() % 101);
+		d[0] = 0xFF;
+		break;
+	}
+}
+
+//生成总大小约SynthSize MB的条目，类型轮流取5种，大小按BucketWeight选档后在档内均匀分布
+struct payload *MakePayloads(unit32 *num)
+{
+	struct payload *p = NULL;
+	unsigned long long total = 0, limit = (unsigned long long)SynthSize << 20;
+	unit32 n = 0, cap = 0, r;
+	int b;
+	while (total < limit || n == 0)
+	{
+		if (n == cap)
+		{
+			cap = cap ? cap * 2 : 1024;
+			p = realloc(p, cap * sizeof(struct payload));
+		}
+		r = Rand() % 100;
+		for (b = 0; b < BUCKETS - 1 && r >= BucketWeight[b]; b++)
+			r -= BucketWeight[b];
+		p[n].len = BucketMin[b] + Rand() % (BucketMax[b] - BucketMin[b]);
+		p[n].type = n % 5;
+		p[n].data = malloc(p[n].len);
+		MakePayload(&p[n]);
+		total += p[n].len;
+		n++;
+	}
+	*num = n;
+	return p;
+}
+
+//写出只有索引表的模板封包，没有数据，打包时由SynthLoad提供内容
+//索引中记下各条目的大小，像重新打包真实的封包一样，写封包时可以据此预先分配缓冲
+//DDP3每个pack块放8个条目，文件名为synth/00000000
+int WriteTemplate(const char *fname, int format, struct payload *p, unit32 num)
+{
+	unit8 *head;
+	unit32 size, packs = (num + 7) / 8, i, k, c, n, pos, pack_size, filesize;
+	const unit32 reclen = 0x11 + 15 * 2;
+	char name[20];
+	FILE *fp;
+	if (format == DDP_FORMAT_DDP2)
+		size = 0x20 + num * 0x10;
+	else
+		size = 0x20 + packs * 8 + num * reclen + packs;
+	head = calloc(size + 4, 1);
+	memcpy(head, format == DDP_FORMAT_DDP2 ? "DDP2" : "DDP3", 4);
+	memcpy(head + 4, format == DDP_FORMAT_DDP2 ? &num : &packs, 4);
+	memcpy(head + 8, &size, 4);
+	if (format == DDP_FORMAT_DDP2)
+		for (i = 0; i < num; i++)
+		{
+			memcpy(head + 0x20 + i * 0x10, &size, 4);
+			memcpy(head + 0x20 + i * 0x10 + 4, &p[i].len, 4);
+		}
+	else
+	{
+		pos = 0x20 + packs * 8;
+		for (i = 0; i < packs; i++)
+		{
+			n = num - i * 8 < 8 ? num - i * 8 : 8;
+			pack_size = n * reclen + 1;
+			memcpy(head + 0x20 + i * 8, &pack_size, 4);
+			memcpy(head + 0x20 + i * 8 + 4, &pos, 4);
+			for (k = 0; k < n; k++)
+			{
+				head[pos] = (unit8)reclen;
+				memcpy(head + pos + 1, &size, 4);
+				memcpy(head + pos + 5, &p[i * 8 + k].len, 4);
+				sprintf(name, "synth/%08u", i * 8 + k);
+				for (c = 0; name[c] != 0; c++)
+					head[pos + 0x11 + c * 2] = name[c];
+				pos += reclen;
+			}
+			pos++;//pack块以0结尾
+		}
+	}
+	filesize = size + 4;
+	memcpy(head + size, &filesize, 4);
+	fp = fopen(fname, "wb");
+	n = fp != NULL && fwrite(head, filesize, 1, fp) == 1;
+	if (fp != NULL)
+		fclose(fp);
+	free(head);
+	return n;
+}
+
+struct synth_ctx
+{
+	struct payload *p;
+	ddp_bufpool *bufs;//和打包工具一样，读入的内容放在可重用的缓冲里
+};
+
+unit8 *SynthLoad(void *ctx, ddp_archive *ar, unit32 i, unit32 *len)
+{
+	struct synth_ctx *sc = ctx;
+	struct payload *p = &sc->p[i];
+	struct ddp_hxb_header hxb_header;
+	unit8 *data = ddp_bufpool_get(sc->bufs, p->len);
+	(void)ar;
+	if (data == NULL)
+		return NULL;
+	memcpy(data, p->data, p->len);
+	if (p->type == DDP_TYPE_HXB)
+	{
+		memcpy(&hxb_header, data, 0x10);
+		ddp_hxb_encrypt(&hxb_header, data, p->len);
+	}
+	*len = p->len;
+	return data;
+}
+
+void SynthRelease(void *ctx, unit8 *data)
+{
+	ddp_bufpool_put(((struct synth_ctx *)ctx)->bufs, data);
+}
+
+void SynthDone(void *ctx, unit32 i, unit8 *data, const struct ddp_entry *e)
+{
+	(void)i;
+	(void)e;
+	SynthRelease(ctx, data);
+}
+
+//解包：和解包工具一样按最大的条目分配一次缓冲，逐个解压(HXB同时解密)到内存，不写文件，只计时库本身
+int SynthUnpack(const char *fname, struct payload *p, unit32 num, struct synth_result *res)
+{
+	ddp_archive *ar;
+	unit8 *data, *owned, *buf;
+	unit32 i, maxlen, maxclen;
+	long allocs = AllocCount;
+	double start = Now();
+	ar = ddp_open(fname, NULL);
+	if (ar == NULL || ddp_entry_count(ar) != num)
+	{
+		ddp_close(ar);
+		return 0;
+	}
+	ddp_max_lengths(ar, &maxlen, &maxclen);
+	buf = malloc((size_t)maxlen + maxclen + 1);
+	for (i = 0; i < num && buf != NULL; i++)
+		if (ddp_load_into(ar, i, buf, maxlen + maxclen) == NULL)
+			break;
+	free(buf);
+	res->unpack.seconds = Now() - start;
+	res->unpack.allocs = AllocsPerEntry(AllocCount - allocs, num);
+	//不计时，再解一遍逐条目对比
+	res->verified = i == num;
+	for (i = 0; i < num && res->verified; i++)
+	{
+		data = ddp_load_decrypted(ar, i, &owned);
+		res->verified = data != NULL && memcmp(data, p[i].data, p[i].len) == 0;
+		free(owned);
+	}
+	res->archive_size = ddp_archive_header(ar)->filesize;
+	ddp_close(ar);
+	return 1;
+}
+
+//按解压后的大小分档，每档单独计时ddp_uncompress
+void SynthDecode(const char *fname, int rounds, struct synth_result *res)
+{
+	ddp_archive *ar = ddp_open(fname, NULL);
+	const struct ddp_entry *e;
+	struct ddp_iter it;
+	struct sample *samples[BUCKETS];
+	unit8 *out;
+	unit32 num[BUCKETS] = { 0 }, maxlen = 0, i;
+	int b;
+	if (ar == NULL)
+		return;
+	for (b = 0; b < BUCKETS; b++)
+		samples[b] = malloc((ddp_entry_count(ar) + 1) * sizeof(struct sample));
+	ddp_iter_begin(&it, ar);
+	while ((e = ddp_iter_next(&it)) != NULL)
+	{
+		b = Bucket(e->uncomprlen);
+		if (e->comprlen == 0)
+		{
+			res->buckets[b].stored++;
+			continue;
+		}
+		i = num[b]++;
+		samples[b][i].compr = malloc(e->comprlen);
+		samples[b][i].comprlen = e->comprlen;
+		samples[b][i].uncomprlen = e->uncomprlen;
+		ddp_read_raw(ar, it.next - 1, samples[b][i].compr, e->comprlen);
+		res->buckets[b].bytes += e->uncomprlen;
+		if (e->uncomprlen > maxlen)
+			maxlen = e->uncomprlen;
+	}
+	ddp_close(ar);
+	out = malloc(maxlen + 1);
+	for (b = 0; b < BUCKETS; b++)
+	{
+		res->buckets[b].entries = num[b];
+		if (num[b] != 0)
+			res->buckets[b].seconds = Run(ddp_uncompress, samples[b], num[b], out, rounds);
+		for (i = 0; i < num[b]; i++)
+			free(samples[b][i].compr);
+		free(samples[b]);
+	}
+	free(out);
+}
+
+double MBs(double bytes, double seconds)
+{
+	return seconds > 0 ? bytes / 1048576 / seconds : 0;
+}
+
+void SynthRun(int format, struct payload *p, unit32 num, double total, int rounds, struct synth_result *res)
+{
+	char tmpname[512], datname[512];
+	struct ddp_write_params params;
+	struct synth_ctx sc;
+	ddp_archive *ar;
+	unit32 maxlen, maxclen;
+	long allocs;
+	double start;
+	int err, b;
+	memset(res, 0, sizeof(*res));
+	res->format = format;
+	sprintf(tmpname, "%s/ddp_bench_%d.tmp", TempDir, format);
+	sprintf(datname, "%s/ddp_bench_%d.dat", TempDir, format);
+	if (!WriteTemplate(tmpname, format, p, num) || (ar = ddp_open(tmpname, &err)) == NULL)
+	{
+		printf("%s: %s\n", tmpname, ddp_strerror(DDP_ERR_WRITE));
+		return;
+	}
+	memset(&params, 0, sizeof(params));
+	params.level = CompressLevel;
+	params.threads = Threads;
+	params.load = SynthLoad;
+	params.done = SynthDone;
+	params.release = SynthRelease;
+	params.ctx = &sc;
+	sc.p = p;
+	allocs = AllocCount;
+	start = Now();
+	ddp_max_lengths(ar, &maxlen, &maxclen);
+	sc.bufs = ddp_bufpool_create(maxlen);
+	err = sc.bufs != NULL ? ddp_write_archive(ar, datname, &params) : DDP_ERR_NOMEM;
+	ddp_bufpool_free(sc.bufs);
+	res->pack.seconds = Now() - start;
+	res->pack.allocs = AllocsPerEntry(AllocCount - allocs, num);
+	ddp_close(ar);
+	remove(tmpname);
+	if (err != DDP_OK || !SynthUnpack(datname, p, num, res))
+	{
+		printf("%s: %s\n", datname, ddp_strerror(err != DDP_OK ? err : DDP_ERR_FORMAT));
+		remove(datname);
+		return;
+	}
+	SynthDecode(datname, rounds, res);
+	remove(datname);
+	res->peak_rss = PeakRSS();
+	printf("DDP%d 条目:%d 内容:%.1fMB 封包:%.1fMB%s\n", format, num, total / 1048576, res->archive_size / 1048576.0, res->verified ? "" : " 解包结果与原内容不一致!");
+	printf("\t打包 %8.1f MB/s %.3fs 每条目分配%.2f次\n", MBs(total, res->pack.seconds), res->pack.seconds, res->pack.allocs);
+	printf("\t解包 %8.1f MB/s %.3fs 每条目分配%.2f次\n", MBs(total, res->unpack.seconds), res->unpack.seconds, res->unpack.allocs);
+	for (b = 0; b < BUCKETS; b++)
+		printf("\t解压 %-9s %8.1f MB/s 压缩条目:%d 未压缩:%d\n", BucketName[b], MBs(res->buckets[b].bytes * rounds, res->buckets[b].seconds), res->buckets[b].entries, res->buckets[b].stored);
+	printf("\t峰值内存 %ldKB\n", res->peak_rss);
+}
+
+void WriteJson(const char *fname, struct synth_result *res, int count, unit32 num, double total, int rounds)
+{
+	FILE *fp = fopen(fname, "w");
+	int i, b;
+	if (fp == NULL)
+	{
+		printf("%s: %s\n", fname, ddp_strerror(DDP_ERR_OPEN));
+		return;
+	}
+	fprintf(fp, "{\n  \"seed\": %u, \"size_mb\": %u, \"level\": %d, \"threads\": %u, \"rounds\": %d,\n", Seed, SynthSize, CompressLevel, Threads, rounds);
+	fprintf(fp, "  \"entries\": %u, \"bytes\": %.0f, \"allocs_counted\": %s,\n  \"results\": [\n", num, total, ALLOC_COUNTED ? "true" : "false");
+	for (i = 0; i < count; i++)
+	{
+		fprintf(fp, "    {\"format\": \"DDP%d\", \"archive_bytes\": %u, \"verified\": %s, \"peak_rss_kb\": %ld,\n", res[i].format, res[i].archive_size, res[i].verified ? "true" : "false", res[i].peak_rss);
+		fprintf(fp, "     \"pack\": {\"seconds\": %.6f, \"mb_s\": %.2f, \"allocs_per_entry\": %.3f},\n", res[i].pack.seconds, MBs(total, res[i].pack.seconds), res[i].pack.allocs);
+		fprintf(fp, "     \"unpack\": {\"seconds\": %.6f, \"mb_s\": %.2f, \"allocs_per_entry\": %.3f},\n", res[i].unpack.seconds, MBs(total, res[i].unpack.seconds), res[i].unpack.allocs);
+		fprintf(fp, "     \"decode\": [");
+		for (b = 0; b < BUCKETS; b++)
+			fprintf(fp, "%s\n       {\"bucket\": \"%s\", \"entries\": %u, \"stored\": %u, \"bytes\": %.0f, \"mb_s\": %.2f}", b ? "," : "", BucketName[b], res[i].buckets[b].entries, res[i].buckets[b].stored, res[i].buckets[b].bytes, MBs(res[i].buckets[b].bytes * rounds, res[i].buckets[b].seconds));
+		fprintf(fp, "]}%s\n", i + 1 < count ? "," : "");
+	}
+	fprintf(fp, "  ]\n}\n");
+	fclose(fp);
+}
+
+//DDP2和DDP3用同一组生成的内容，结果可以直接对比
+void BenchSynth(int rounds, const char *json)
+{
+	struct synth_result res[2];
+	struct payload *p;
+	unit32 num, i, seed = Seed;
+	double total = 0;
+	p = MakePayloads(&num);
+	for (i = 0; i < num; i++)
+		total += p[i].len;
+	SynthRun(DDP_FORMAT_DDP2, p, num, total, rounds, &res[0]);
+	SynthRun(DDP_FORMAT_DDP3, p, num, total, rounds, &res[1]);
+	Seed = seed;
+	if (json != NULL)
+		WriteJson(json, res, 2, num, total, rounds);
+	for (i = 0; i < num; i++)
+		free(p[i].data);
+	free(p);
+}
+
+int main(int argc, char *argv[])
+{
+	char *json = NULL;
+	int i, rounds = 5, gen = 0;
+#if defined(_MSC_VER) && defined(_DEBUG)
+	_CrtSetAllocHook(AllocHook);
+#endif
+	printf("DDP解压速度测试\n用法：DDP_bench [-n 轮数] a.dat [b.dat ...]\n      DDP_bench -gen [-size MB] [-seed N] [-store|-fast|-lazy|-optimal] [-j N] [-dir 临时目录] [-o result.json]\n\n");
+	for (i = 1; i < argc; i++)
+	{
+		if (strcmp(argv[i], "-n") == 0 && i + 1 < argc)
+			rounds = atoi(argv[++i]);
+		else if (strcmp(argv[i], "-gen") == 0)
+			gen = 1;
+		else if (strcmp(argv[i], "-size") == 0 && i + 1 < argc)
+			SynthSize = atoi(argv[++i]);
+		else if (strcmp(argv[i], "-seed") == 0 && i + 1 < argc)
+		{
+			Seed = strtoul(argv[++i], NULL, 10);
+			if (Seed == 0)//xorshift的状态不能为0
+				Seed = 1;
+		}
+		else if (strcmp(argv[i], "-store") == 0)
+			CompressLevel = DDP_LEVEL_STORE;
+		else if (strcmp(argv[i], "-fast") == 0)
+			CompressLevel = DDP_LEVEL_FAST;
+		else if (strcmp(argv[i], "-lazy") == 0)
+			CompressLevel = DDP_LEVEL_LAZY;
+		else if (strcmp(argv[i], "-optimal") == 0)
+			CompressLevel = DDP_LEVEL_OPTIMAL;
+		else if (strcmp(argv[i], "-j") == 0 && i + 1 < argc)
+			Threads = atoi(argv[++i]);
+		else if (strcmp(argv[i], "-dir") == 0 && i + 1 < argc)
+			TempDir = argv[++i];
+		else if (strcmp(argv[i], "-o") == 0 && i + 1 < argc)
+			json = argv[++i];
+		else
+			BenchFile(argv[i], rounds > 0 ? rounds : 1);
+	}
+	if (gen)
+		BenchSynth(rounds > 0 ? rounds : 1, json);
+	return 0;
+}
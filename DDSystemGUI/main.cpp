@@ -10,13 +10,22 @@
 #include <FL/Fl_Native_File_Chooser.H>
 #include <FL/Fl_Text_Display.H>
 #include <FL/Fl_Text_Buffer.H>
+#include <FL/Fl_Progress.H>
+#include <FL/Fl_Table_Row.H>
+#include <FL/fl_draw.H>
+#include <FL/fl_utf8.h>
 #include <string>
-#include <cstdio> // For _popen, _pclose
-#include <cstdlib> // For system, EXIT_FAILURE, EXIT_SUCCESS (though _popen is preferred)
-#include <stdexcept> // For std::runtime_error
+#include <cstring>
 #include <vector>
 #include <iostream> // For cerr
+#include <list>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <chrono>
 #include <windows.h> // 用于文件检查
+#include "ddp.h"
 #pragma execution_character_set("utf-8")
 
 // --- Custom Color Scheme ---
@@ -31,108 +40,217 @@
 #define COLOR_WARNING       fl_rgb_color(230, 126, 34)     // 警告色：橙色
 #define COLOR_INPUT_BG      fl_rgb_color(248, 248, 255)    // 输入框背景色
 
-// --- Configuration ---
-const char* DDP2_PACK_EXE = "lib\\DDP2_pack.exe";
-const char* DDP2_UNPACK_EXE = "lib\\DDP2_unpack.exe";
-const char* DDP3_PACK_EXE = "lib\\DDP3_pack_wchar.exe";
-const char* DDP3_UNPACK_EXE = "lib\\DDP3_unpack_wchar.exe";
-
 // --- Global Widgets ---
 Fl_Text_Display* output_display = nullptr;
 Fl_Text_Buffer* output_buffer = nullptr;
+Fl_Progress* progress_bar = nullptr;
+Fl_Button* cancel_button = nullptr;
+
+// --- Background Jobs ---
+// 每个任务在自己的线程中直接调用libddp解包或打包，界面线程不再等待，可以同时运行多个任务
+struct Job {
+    int id = 0;
+    bool pack = false;
+    std::string archive;                // 封包路径，本地代码页
+    std::string dir;                    // 打包读取、解包写出的目录，本地代码页
+    std::string outname;                // 打包写出的新封包，本地代码页；为空时为<封包>_new
+    std::string prefix;                 // 输出前面的任务编号，同时运行的任务的输出可以区分
+    unsigned threads = 1;               // 这个任务占用的线程数，开始时从空闲的核心中分配
+    std::atomic<unit32> total{0};       // 封包的条目数，打开封包后才知道
+    std::atomic<unit32> done{0};        // 已处理的条目数
+    volatile int cancel = 0;            // 交给libddp，置为非0后不再处理新的条目
+    std::mutex lock;                    // 保护下面的成员
+    std::string pending;                // 还没交给界面线程的输出
+    bool flush_queued = false;          // 已经Fl::awake过，界面线程还没取走pending
+    bool finished = false;
+    std::thread worker;
+};
+
+std::list<Job*> jobs; // 只在界面线程中访问
+int next_job_id = 1;
+unsigned threads_in_use = 0; // 进行中的任务占用的线程数之和，只在界面线程中访问
+std::mutex awake_lock; // 界面线程每取走一次输出通知一次，Fl::awake的队列满时工作线程在这里等
+std::condition_variable awake_cv;
+
+#define JOB_BUDGET (64u << 20) // 所有任务压缩时已压缩未写出的数据共用的内存预算，按占用的线程数分给各任务
 
-// --- 检查可执行程序是否存在 ---
-bool file_exists(const char* path) {
-    DWORD fileAttributes = GetFileAttributesA(path);
-    return (fileAttributes != INVALID_FILE_ATTRIBUTES && 
-            !(fileAttributes & FILE_ATTRIBUTE_DIRECTORY));
+// --- 输出提示信息 ---
+void append_output(const std::string& text) {
+    if (output_buffer && output_display) {
+        output_buffer->append(text.c_str());
+        output_display->scroll(output_buffer->length(), 0); // Scroll to end
+    }
 }
 
-void check_executables() {
-    if (output_buffer && output_display) {
-        output_buffer->append("正在检查必要的可执行程序...\n");
-        
-        struct ExeInfo {
-            const char* path;
-            const char* name;
-            bool found;
-        };
-        
-        ExeInfo exes[] = {
-            { DDP2_PACK_EXE, "DDP2打包程序", false },
-            { DDP2_UNPACK_EXE, "DDP2解包程序", false },
-            { DDP3_PACK_EXE, "DDP3打包程序(wchar)", false },
-            { DDP3_UNPACK_EXE, "DDP3解包程序(wchar)", false }
-        };
-        
-        int missing_count = 0;
-        
-        for (auto& exe : exes) {
-            exe.found = file_exists(exe.path);
-            if (exe.found) {
-                output_buffer->append("✅ ");
-                output_buffer->append(exe.name);
-                output_buffer->append(" 已找到: ");
-            } else {
-                output_buffer->append("❌ ");
-                output_buffer->append(exe.name);
-                output_buffer->append(" 未找到: ");
-                missing_count++;
-            }
-            output_buffer->append(exe.path);
-            output_buffer->append("\n");
-        }
-        
-        output_buffer->append("\n");
-        if (missing_count == 0) {
-            output_buffer->append("✨ 所有程序检查完毕，系统准备就绪！\n");
-        } else {
-            output_buffer->append("⚠️ 警告：有 ");
-            output_buffer->append(std::to_string(missing_count).c_str());
-            output_buffer->append(" 个程序未找到，部分功能可能无法使用。\n");
-            output_buffer->append("请确保所有可执行文件都在正确的位置。\n");
-        }
-        output_buffer->append("\n");
-        
-        output_display->scroll(output_buffer->length(), 0); // 滚动到底部
+unsigned hardware_threads() {
+    unsigned n = std::thread::hardware_concurrency();
+    return n != 0 ? n : 1;
+}
+
+// --- 任务的进度和输出 ---
+// 进度条显示所有进行中的任务已处理的条目数占总条目数的比例
+void update_progress() {
+    unit32 total = 0, done = 0;
+    for (Job* job : jobs) {
+        unit32 job_total = job->total, job_done = job->done;
+        total += job_total;
+        done += job_done > job_total ? job_total : job_done;
     }
+    if (jobs.empty()) {
+        progress_bar->value(0);
+        progress_bar->label("空闲");
+        cancel_button->deactivate();
+        return;
+    }
+    std::string label = std::to_string(jobs.size()) + "个任务进行中";
+    if (total != 0) {
+        label += "  " + std::to_string(done) + "/" + std::to_string(total);
+    }
+    progress_bar->maximum(total != 0 ? (float)total : 1.0f);
+    progress_bar->value(total != 0 ? (float)done : 0.0f);
+    progress_bar->copy_label(label.c_str());
+    cancel_button->activate();
 }
 
-// --- Helper Function to Execute Command and Capture Output ---
-std::string execute_command(const std::string& command) {
-    std::string result = "";
-    std::vector<char> buffer(128);
-    FILE* pipe = _popen(command.c_str(), "r"); // Execute command and open read pipe
+// 界面线程中取走任务的输出；任务结束时回收线程
+void flush_job_cb(void* data) {
+    Job* job = (Job*)data;
+    std::string text;
+    bool finished;
+    {
+        std::lock_guard<std::mutex> guard(job->lock);
+        text.swap(job->pending);
+        job->flush_queued = false;
+        finished = job->finished;
+    }
+    {
+        std::lock_guard<std::mutex> guard(awake_lock);
+    }
+    awake_cv.notify_all();
+    if (!text.empty()) {
+        append_output(text);
+    }
+    if (finished) {
+        job->worker.join();
+        threads_in_use -= job->threads;
+        jobs.remove(job);
+        delete job;
+    }
+    update_progress();
+}
 
-    if (!pipe) {
-        return "Error: Failed to execute command: " + command + "\n";
+// 工作线程中调用，输出先攒在pending里，同一时间只排一个Fl::awake，输出很多时也不会占满FLTK的消息队列
+// 返回是否有Fl::awake在等待界面线程处理
+bool post_output(Job* job, const std::string& text, bool finished = false) {
+    std::lock_guard<std::mutex> guard(job->lock);
+    job->pending += text;
+    job->finished = finished;
+    if (!job->flush_queued) {
+        job->flush_queued = Fl::awake(flush_job_cb, job) == 0;
     }
+    return job->flush_queued;
+}
 
-    try {
-        size_t bytesread;
-        while ((bytesread = fread(buffer.data(), 1, buffer.size(), pipe)) != 0) {
-            result += std::string(buffer.data(), bytesread);
-        }
-    } catch (...) {
-        _pclose(pipe);
-        return "Error: Exception while reading command output.\n";
+// 以下在工作线程中调用。libddp每处理完一个条目回调一次，这里只计数和报告失败的条目，
+// 进度条在界面线程取走输出时一起刷新，Fl::awake同一时间只排一个
+void unpack_entry_cb(void* ctx, unit32 a, unit32 i, const struct ddp_entry* e, int type, int err) {
+    Job* job = (Job*)ctx;
+    job->done++;
+    post_output(job, err == DDP_OK ? "" : job->prefix + "第" + std::to_string(i) + "个条目: " + ddp_strerror(err) + "\n");
+}
+
+void pack_entry_cb(void* ctx, unit32 i, const struct ddp_entry* e, int kept) {
+    Job* job = (Job*)ctx;
+    job->done++;
+    post_output(job, "");
+}
+
+std::string unpack_archive(Job* job, ddp_archive* ar) {
+    struct ddp_unpack_params params;
+    struct ddp_unpack_result result;
+    const char* fname = job->archive.c_str();
+    const char* outdir = job->dir.c_str();
+    memset(&params, 0, sizeof(params));
+    params.threads = job->threads;
+    params.outdirs = &outdir;
+    params.done = unpack_entry_cb;
+    params.ctx = job;
+    params.cancel = &job->cancel;
+    ddp_unpack_archives(&ar, &fname, 1, &params, &result);
+    std::string text = job->prefix + "DDP" + std::to_string(ddp_archive_format(ar)) + " 条目:" + std::to_string(result.count);
+    ddp_close(ar);
+    if (result.err != DDP_OK) {
+        return text + " 解包失败: " + ddp_strerror(result.err) + "\n";
+    }
+    text += " 共用数据区:" + std::to_string(result.shared) + " 失败:" + std::to_string(result.failed) + " 共" + std::to_string(result.bytes) + "字节\n";
+    if (result.manifest_err) {
+        text += job->prefix + "清单" + DDP_MANIFEST_NAME + "写出失败\n";
     }
+    return text;
+}
 
-    int exit_code = _pclose(pipe); // Close pipe and get exit code
-    result += "\n--------------------\n";
-    result += "命令执行结束，退出码: " + std::to_string(exit_code) + "\n";
+// 以选定的原封包为模板，新封包写到选定的输出文件，没有选时与命令行工具相同写到<封包>_new
+std::string pack_archive(Job* job, ddp_archive* ar) {
+    struct ddp_pack_params params;
+    std::string outname = !job->outname.empty() ? job->outname : job->archive + "_new";
+    memset(&params, 0, sizeof(params));
+    params.level = DDP_LEVEL_LAZY;
+    params.dedup = 1;
+    params.threads = job->threads;
+    params.budget = (unit32)((unsigned long long)JOB_BUDGET * job->threads / hardware_threads());
+    params.done = pack_entry_cb;
+    params.ctx = job;
+    params.cancel = &job->cancel;
+    int err = ddp_pack_archive(ar, job->archive.c_str(), job->dir.c_str(), outname.c_str(), &params);
+    std::string text;
+    if (!params.has_manifest) {
+        text = job->prefix + "没有找到有效的清单" + DDP_MANIFEST_NAME + "，已读取原条目判断类型\n";
+    }
+    if (err != DDP_OK && err != DDP_ERR_CANCELLED && params.missing != DDP_NOT_FOUND) {
+        text += job->prefix + "第" + std::to_string(params.missing) + "个条目的文件" + ddp_strerror(DDP_ERR_OPEN) + "\n";
+    } else if (err != DDP_OK) {
+        text += job->prefix + "打包失败: " + ddp_strerror(err) + "\n";
+    } else {
+        text += job->prefix + outname + ": DDP" + std::to_string(ddp_archive_format(ar)) + " 条目:" + std::to_string(ddp_entry_count(ar)) + " file_size:" + std::to_string(params.filesize) + " 共用数据区省下:" + std::to_string(params.saved) + "字节\n";
+    }
+    ddp_close(ar);
+    return text;
+}
 
-    return result;
+void run_job(Job* job) {
+    int err;
+    std::string result;
+    ddp_archive* ar = ddp_open(job->archive.c_str(), &err);
+    if (ar == nullptr) {
+        result = job->prefix + job->archive + ": " + ddp_strerror(err) + "\n";
+    } else {
+        job->total = ddp_entry_count(ar);
+        result = job->pack ? pack_archive(job, ar) : unpack_archive(job, ar);
+    }
+    // 最后一次一定要送到界面线程，否则任务不会被回收；FLTK的队列满时等界面线程取走一次输出再试
+    // 持有awake_lock直到开始等待，界面线程的通知不会在两者之间漏掉
+    std::unique_lock<std::mutex> guard(awake_lock);
+    while (!post_output(job, result, true)) {
+        result.clear();
+        awake_cv.wait(guard);
+    }
 }
 
-// --- 输出提示信息 ---
-void append_output(const std::string& text) {
-    if (output_buffer && output_display) {
-        output_buffer->append(text.c_str());
-        output_display->scroll(output_buffer->length(), 0); // Scroll to end
+// 取消所有进行中的任务：libddp不再处理新的条目，正在处理的条目完成后返回
+void cancel_jobs_cb(Fl_Widget* w, void* data) {
+    for (Job* job : jobs) {
+        job->cancel = 1;
     }
 }
 
+// 界面中的路径是UTF-8，libddp按本地代码页打开文件
+std::string to_local(const char* utf8) {
+    unsigned len = (unsigned)strlen(utf8);
+    std::vector<char> local(fl_utf8to_mb(utf8, len, nullptr, 0) + 1);
+    fl_utf8to_mb(utf8, len, local.data(), (unsigned)local.size());
+    return local.data();
+}
+
 // --- Callback Functions ---
 
 // Generic Browse Folder Callback
@@ -152,65 +270,275 @@ void browse_file_input_cb(Fl_Widget* w, void* data) {
     Fl_Native_File_Chooser fnfc;
     fnfc.title("选择输入文件");
     fnfc.type(Fl_Native_File_Chooser::BROWSE_FILE);
-    fnfc.filter("DDP Files\t*.ddp\nAll Files\t*.*"); // Adjust filter if needed
+    fnfc.filter("DAT Files\t*.dat\nAll Files\t*.*");
     if (fnfc.show() == 0) {
         input_field->value(fnfc.filename());
     }
 }
 
-// Generic Browse File Callback (for output DDP)
+// Generic Browse File Callback (for output archive)
 // 选择输出文件
 void browse_file_output_cb(Fl_Widget* w, void* data) {
     Fl_Input* input_field = (Fl_Input*)data;
     Fl_Native_File_Chooser fnfc;
     fnfc.title("选择输出文件");
     fnfc.type(Fl_Native_File_Chooser::BROWSE_SAVE_FILE);
-    fnfc.filter("DDP Files\t*.ddp\nAll Files\t*.*"); // Adjust filter if needed
+    fnfc.filter("DAT Files\t*.dat\nAll Files\t*.*");
     fnfc.options(Fl_Native_File_Chooser::SAVEAS_CONFIRM);
     if (fnfc.show() == 0) {
-        std::string filename = fnfc.filename();
-        // Ensure .ddp extension (optional)
-        if (filename.length() < 4 || filename.substr(filename.length() - 4) != ".ddp") {
-             filename += ".ddp";
-        }
-        input_field->value(filename.c_str());
+        input_field->value(fnfc.filename());
     }
 }
 
 
 // Execute Callbacks (Wrap execution logic)
-void run_tool(const char* exe_path, const char* input_arg, const char* output_arg) {
-     if (strlen(input_arg) == 0 || strlen(output_arg) == 0) {
+// 两种格式按文件头识别，DDP2和DDP3的标签页使用同一个引擎
+void start_job(bool pack, const char* archive, const char* dir, const char* outname = "") {
+     if (strlen(archive) == 0 || strlen(dir) == 0) {
         append_output("Error: 请选择输入和输出路径.\n");
         append_output("Error: Please select both input and output paths.\n");
         return;
     }
-    std::string command = "\"" + std::string(exe_path) + "\" \"" + std::string(input_arg) + "\" \"" + std::string(output_arg) + "\"";
-    append_output("Executing: " + command + "\n");
-    std::string result = execute_command(command);
-    append_output(result);
+    Job* job = new Job();
+    job->id = next_job_id++;
+    job->pack = pack;
+    job->archive = to_local(archive);
+    job->dir = to_local(dir);
+    job->outname = to_local(outname);
+    job->prefix = "[#" + std::to_string(job->id) + "] ";
+    // 同时运行的任务分用CPU核心，先开始的任务占着的不再分出去，每个任务至少一个线程
+    unsigned hw = hardware_threads();
+    job->threads = threads_in_use < hw ? hw - threads_in_use : 1;
+    threads_in_use += job->threads;
+    append_output(job->prefix + (pack ? "打包: " : "解包: ") + archive + (pack ? " <- " : " -> ") + dir + "\n");
+    jobs.push_back(job);
+    job->worker = std::thread(run_job, job);
+    update_progress();
 }
 
-void exec_ddp2_pack_cb(Fl_Widget* w, void* data) {
-    Fl_Input** inputs = (Fl_Input**)data; // 0: input folder, 1: output file
-    run_tool(DDP2_PACK_EXE, inputs[0]->value(), inputs[1]->value());
+// 打包: 0为解包出的文件夹，1为作为模板的原封包，2为输出文件(可以不填)
+void exec_pack_cb(Fl_Widget* w, void* data) {
+    Fl_Input** inputs = (Fl_Input**)data;
+    start_job(true, inputs[1]->value(), inputs[0]->value(), inputs[2]->value());
 }
 
-void exec_ddp2_unpack_cb(Fl_Widget* w, void* data) {
-    Fl_Input** inputs = (Fl_Input**)data; // 0: input file, 1: output folder
-    run_tool(DDP2_UNPACK_EXE, inputs[0]->value(), inputs[1]->value());
+// 解包: 0为封包，1为输出文件夹
+void exec_unpack_cb(Fl_Widget* w, void* data) {
+    Fl_Input** inputs = (Fl_Input**)data;
+    start_job(false, inputs[0]->value(), inputs[1]->value());
 }
 
-void exec_ddp3_pack_cb(Fl_Widget* w, void* data) {
-    Fl_Input** inputs = (Fl_Input**)data; // 0: input folder, 1: output file
-    run_tool(DDP3_PACK_EXE, inputs[0]->value(), inputs[1]->value());
+
+// --- Archive Browser ---
+// 打开封包只读取文件头和索引表；列表只绘制可见的行，字段按需从索引中取，
+// 类型也只对可见的行解压开头几个字节判断，不为每个条目保存任何东西
+class EntryTable : public Fl_Table_Row {
+public:
+    ddp_archive* ar = nullptr;
+
+    EntryTable(int x, int y, int w, int h) : Fl_Table_Row(x, y, w, h) {
+        cols(6);
+        col_header(1);
+        col_resize(1);
+        row_header(0);
+        row_height_all(18);
+        col_width(0, 50);
+        col_width(1, 85);
+        col_width(2, 80);
+        col_width(3, 80);
+        col_width(4, 45);
+        col_width(5, 180);
+        type(SELECT_SINGLE);
+        color(COLOR_INPUT_BG);
+        end();
+    }
+
+    // 换成新的封包，关闭原来的封包
+    void open(ddp_archive* archive) {
+        if (ar != nullptr) {
+            ddp_close(ar);
+        }
+        ar = archive;
+        rows(ar != nullptr ? ddp_entry_count(ar) : 0);
+        row_position(0);
+        redraw();
+    }
+
+    // 选中的条目，没有时返回DDP_NOT_FOUND
+    unit32 selected() {
+        for (int r = 0; r < rows(); r++) {
+            if (row_selected(r)) {
+                return (unit32)r;
+            }
+        }
+        return DDP_NOT_FOUND;
+    }
+
+protected:
+    void draw_cell(TableContext context, int R, int C, int X, int Y, int W, int H) override {
+        static const char* headers[] = { "#", "Offset", "Comprlen", "Uncomprlen", "Type", "Name" };
+        char text[512];
+        switch (context) {
+        case CONTEXT_STARTPAGE:
+            fl_font(FL_HELVETICA, 12);
+            return;
+        case CONTEXT_COL_HEADER:
+            fl_push_clip(X, Y, W, H);
+            fl_draw_box(FL_THIN_UP_BOX, X, Y, W, H, COLOR_BG);
+            fl_color(COLOR_TEXT_DARK);
+            fl_draw(headers[C], X + 4, Y, W - 4, H, FL_ALIGN_LEFT);
+            fl_pop_clip();
+            return;
+        case CONTEXT_CELL:
+            entry_text((unit32)R, C, text, sizeof(text));
+            fl_push_clip(X, Y, W, H);
+            fl_color(row_selected(R) ? COLOR_PRIMARY : COLOR_INPUT_BG);
+            fl_rectf(X, Y, W, H);
+            fl_color(row_selected(R) ? COLOR_TEXT_LIGHT : COLOR_TEXT_DARK);
+            fl_draw(text, X + 4, Y, W - 4, H, FL_ALIGN_LEFT);
+            fl_pop_clip();
+            return;
+        default:
+            return;
+        }
+    }
+
+private:
+    void entry_text(unit32 i, int column, char* text, unsigned len) {
+        struct ddp_entry e;
+        ddp_get_entry(ar, i, &e);
+        switch (column) {
+        case 0: snprintf(text, len, "%u", i); break;
+        case 1: snprintf(text, len, "0x%08X", e.offset); break;
+        case 2: snprintf(text, len, "0x%X", e.comprlen); break;
+        case 3: snprintf(text, len, "0x%X", e.uncomprlen); break;
+        case 4: snprintf(text, len, "%s", ddp_type_ext(ddp_entry_type(ar, i))); break;
+        default: entry_name(&e, text, len); break;
+        }
+    }
+
+public:
+    // DDP3的文件名是UTF-16LE，转成UTF-8；DDP2没有文件名，返回空串
+    static void entry_name(const struct ddp_entry* e, char* text, unsigned len) {
+        wchar_t name[MAX_PATH];
+        unsigned n = e->name != nullptr ? e->namelen / 2 : 0;
+        if (n > MAX_PATH) {
+            n = MAX_PATH;
+        }
+        if (n != 0) {
+            memcpy(name, e->name, n * 2);
+        }
+        while (n > 0 && name[n - 1] == 0) {
+            n--;
+        }
+        fl_utf8fromwc(text, len, name, n);
+    }
+};
+
+EntryTable* entry_table = nullptr;
+
+// 解压选中的条目(HXB同时解密)，返回数据，*owned为需要free的缓冲
+unit8* load_selected(unit32* index, unit32* len, unit8** owned) {
+    struct ddp_entry e;
+    *owned = nullptr;
+    *index = entry_table->ar != nullptr ? entry_table->selected() : DDP_NOT_FOUND;
+    if (*index == DDP_NOT_FOUND) {
+        append_output("Error: 请先打开封包并选择条目.\n");
+        return nullptr;
+    }
+    *len = ddp_get_entry(entry_table->ar, *index, &e)->uncomprlen;
+    unit8* data = ddp_load_decrypted(entry_table->ar, *index, owned);
+    if (data == nullptr) {
+        append_output("第" + std::to_string(*index) + "个条目: " + ddp_strerror(DDP_ERR_READ) + "\n");
+    }
+    return data;
 }
 
-void exec_ddp3_unpack_cb(Fl_Widget* w, void* data) {
-    Fl_Input** inputs = (Fl_Input**)data; // 0: input file, 1: output folder
-    run_tool(DDP3_UNPACK_EXE, inputs[0]->value(), inputs[1]->value());
+void open_archive(const char* fname) {
+    int err;
+    auto start = std::chrono::steady_clock::now();
+    ddp_archive* ar = ddp_open(to_local(fname).c_str(), &err);
+    auto elapsed = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    if (ar == nullptr) {
+        append_output(std::string(fname) + ": " + ddp_strerror(err) + "\n");
+        return;
+    }
+    entry_table->open(ar);
+    char text[128];
+    snprintf(text, sizeof(text), "DDP%d 条目:%u file_size:0x%X 打开用时%.2fms\n", ddp_archive_format(ar), ddp_entry_count(ar), ddp_archive_header(ar)->filesize, elapsed);
+    append_output(std::string(fname) + ": " + text);
 }
 
+void browse_open_cb(Fl_Widget* w, void* data) {
+    Fl_Input* input_field = (Fl_Input*)data;
+    browse_file_input_cb(w, data);
+    if (strlen(input_field->value()) != 0) {
+        open_archive(input_field->value());
+    }
+}
+
+void open_input_cb(Fl_Widget* w, void* data) {
+    open_archive(((Fl_Input*)w)->value());
+}
+
+// 在输出区域显示条目开头的十六进制
+void preview_entry_cb(Fl_Widget* w, void* data) {
+    unit32 i, len;
+    unit8* owned;
+    unit8* udata = load_selected(&i, &len, &owned);
+    if (udata == nullptr) {
+        return;
+    }
+    std::string text = "条目" + std::to_string(i) + " (" + ddp_type_ext(ddp_sniff(udata, len)) + ", " + std::to_string(len) + "字节):\n";
+    char line[96];
+    for (unit32 pos = 0; pos < len && pos < 256; pos += 16) {
+        int n = snprintf(line, sizeof(line), "%08X ", pos);
+        for (unit32 k = pos; k < pos + 16; k++) {
+            n += snprintf(line + n, sizeof(line) - n, k < len ? " %02X" : "   ", k < len ? udata[k] : 0);
+        }
+        n += snprintf(line + n, sizeof(line) - n, "  ");
+        for (unit32 k = pos; k < pos + 16 && k < len; k++) {
+            line[n++] = udata[k] >= 0x20 && udata[k] < 0x7F ? (char)udata[k] : '.';
+        }
+        line[n++] = '\n';
+        text.append(line, n);
+    }
+    free(owned);
+    append_output(text);
+}
+
+// 导出选中的条目，默认文件名与解包时相同
+void export_entry_cb(Fl_Widget* w, void* data) {
+    unit32 i, len;
+    unit8* owned;
+    unit8* udata = load_selected(&i, &len, &owned);
+    if (udata == nullptr) {
+        return;
+    }
+    struct ddp_entry e;
+    char name[512];
+    EntryTable::entry_name(ddp_get_entry(entry_table->ar, i, &e), name, sizeof(name));
+    std::string preset = name;
+    if (preset.empty()) {
+        snprintf(name, sizeof(name), "%08u", i);
+        preset = name;
+    }
+    preset = preset.substr(preset.find_last_of("/\\") + 1) + "." + ddp_type_ext(ddp_sniff(udata, len));
+    Fl_Native_File_Chooser fnfc;
+    fnfc.title("导出条目");
+    fnfc.type(Fl_Native_File_Chooser::BROWSE_SAVE_FILE);
+    fnfc.options(Fl_Native_File_Chooser::SAVEAS_CONFIRM);
+    fnfc.preset_file(preset.c_str());
+    if (fnfc.show() == 0) {
+        FILE* dst = fl_fopen(fnfc.filename(), "wb");
+        bool ok = dst != nullptr && (len == 0 || fwrite(udata, len, 1, dst) == 1);
+        if (dst != nullptr && fclose(dst) != 0) {
+            ok = false;
+        }
+        append_output(std::string(fnfc.filename()) + (ok ? ": 已导出\n" : ": 写入失败\n"));
+    }
+    free(owned);
+}
 
 // --- Main Function ---
 int main(int argc, char **argv) {
@@ -229,9 +557,10 @@ int main(int argc, char **argv) {
     const int button_h = 30;
 
     const int win_w = label_w + input_w + browse_w + padding * 4; // Calculate window width
-    const int win_h = 480; // Increased height for padding
-    const int tabs_h = 220; // Increased height for tabs content
-    const int output_y = tabs_h + padding * 2;
+    const int win_h = 595; // Increased height for padding
+    const int tabs_h = 300; // Increased height for tabs content
+    const int progress_y = tabs_h + padding * 2;
+    const int output_y = progress_y + widget_h + padding * 2;
     const int output_h = win_h - output_y - padding;
 
 
@@ -266,6 +595,17 @@ int main(int argc, char **argv) {
         btn_browse_folder_d2p->color(COLOR_SECONDARY);
         btn_browse_folder_d2p->labelcolor(COLOR_TEXT_DARK);
 
+        current_y += widget_h + padding;
+        Fl_Input* in_file_d2p = new Fl_Input(padding + label_w, current_y, input_w, widget_h, "Source File:");
+        in_file_d2p->align(FL_ALIGN_LEFT);
+        in_file_d2p->color(COLOR_INPUT_BG);
+        in_file_d2p->textcolor(COLOR_TEXT_DARK);
+        in_file_d2p->labelcolor(COLOR_TEXT_DARK);
+        Fl_Button* btn_browse_src_d2p = new Fl_Button(in_file_d2p->x() + input_w + padding, current_y, browse_w, widget_h, "浏览...");
+        btn_browse_src_d2p->box(FL_GLEAM_UP_BOX);
+        btn_browse_src_d2p->color(COLOR_SECONDARY);
+        btn_browse_src_d2p->labelcolor(COLOR_TEXT_DARK);
+
         current_y += widget_h + padding;
         Fl_Input* out_file_d2p = new Fl_Input(padding + label_w, current_y, input_w, widget_h, "Output File:");
         out_file_d2p->align(FL_ALIGN_LEFT);
@@ -284,10 +624,11 @@ int main(int argc, char **argv) {
         btn_exec_d2p->labelcolor(COLOR_TEXT_LIGHT);
         btn_exec_d2p->labelfont(FL_BOLD);
 
-        static Fl_Input* d2p_inputs[] = {in_folder_d2p, out_file_d2p}; // For callback
+        static Fl_Input* d2p_inputs[] = {in_folder_d2p, in_file_d2p, out_file_d2p}; // For callback
         btn_browse_folder_d2p->callback(browse_folder_cb, in_folder_d2p);
+        btn_browse_src_d2p->callback(browse_file_input_cb, in_file_d2p);
         btn_browse_file_d2p->callback(browse_file_output_cb, out_file_d2p);
-        btn_exec_d2p->callback(exec_ddp2_pack_cb, d2p_inputs);
+        btn_exec_d2p->callback(exec_pack_cb, d2p_inputs);
         grp_ddp2_pack->end();
     }
 
@@ -331,7 +672,7 @@ int main(int argc, char **argv) {
         static Fl_Input* d2u_inputs[] = {in_file_d2u, out_folder_d2u}; // For callback
         btn_browse_file_d2u->callback(browse_file_input_cb, in_file_d2u);
         btn_browse_folder_d2u->callback(browse_folder_cb, out_folder_d2u);
-        btn_exec_d2u->callback(exec_ddp2_unpack_cb, d2u_inputs);
+        btn_exec_d2u->callback(exec_unpack_cb, d2u_inputs);
         grp_ddp2_unpack->end();
     }
 
@@ -354,6 +695,17 @@ int main(int argc, char **argv) {
         btn_browse_folder_d3p->color(COLOR_SECONDARY);
         btn_browse_folder_d3p->labelcolor(COLOR_TEXT_LIGHT);
 
+        current_y += widget_h + padding;
+        Fl_Input* in_file_d3p = new Fl_Input(padding + label_w, current_y, input_w, widget_h, "Source File:");
+        in_file_d3p->align(FL_ALIGN_LEFT);
+        in_file_d3p->color(COLOR_INPUT_BG);
+        in_file_d3p->textcolor(COLOR_TEXT_DARK);
+        in_file_d3p->labelcolor(COLOR_TEXT_DARK);
+        Fl_Button* btn_browse_src_d3p = new Fl_Button(in_file_d3p->x() + input_w + padding, current_y, browse_w, widget_h, "Browse...");
+        btn_browse_src_d3p->box(FL_GLEAM_UP_BOX);
+        btn_browse_src_d3p->color(COLOR_SECONDARY);
+        btn_browse_src_d3p->labelcolor(COLOR_TEXT_LIGHT);
+
         current_y += widget_h + padding;
         Fl_Input* out_file_d3p = new Fl_Input(padding + label_w, current_y, input_w, widget_h, "Output File:");
         out_file_d3p->align(FL_ALIGN_LEFT);
@@ -372,10 +724,11 @@ int main(int argc, char **argv) {
         btn_exec_d3p->labelcolor(COLOR_TEXT_LIGHT);
         btn_exec_d3p->labelfont(FL_BOLD);
 
-        static Fl_Input* d3p_inputs[] = {in_folder_d3p, out_file_d3p}; // For callback
+        static Fl_Input* d3p_inputs[] = {in_folder_d3p, in_file_d3p, out_file_d3p}; // For callback
         btn_browse_folder_d3p->callback(browse_folder_cb, in_folder_d3p);
+        btn_browse_src_d3p->callback(browse_file_input_cb, in_file_d3p);
         btn_browse_file_d3p->callback(browse_file_output_cb, out_file_d3p);
-        btn_exec_d3p->callback(exec_ddp3_pack_cb, d3p_inputs);
+        btn_exec_d3p->callback(exec_pack_cb, d3p_inputs);
         grp_ddp3_pack->end();
     }
 
@@ -419,12 +772,65 @@ int main(int argc, char **argv) {
         static Fl_Input* d3u_inputs[] = {in_file_d3u, out_folder_d3u}; // For callback
         btn_browse_file_d3u->callback(browse_file_input_cb, in_file_d3u);
         btn_browse_folder_d3u->callback(browse_folder_cb, out_folder_d3u);
-        btn_exec_d3u->callback(exec_ddp3_unpack_cb, d3u_inputs);
+        btn_exec_d3u->callback(exec_unpack_cb, d3u_inputs);
         grp_ddp3_unpack->end();
     }
 
+    // --- Browse Tab ---
+    {
+        Fl_Group *grp_browse = new Fl_Group(padding, padding + widget_h, win_w - padding * 2, tabs_h - widget_h, "Browse");
+        grp_browse->box(FL_FLAT_BOX);
+        grp_browse->color(COLOR_BG);
+        grp_browse->labelcolor(COLOR_TEXT_DARK);
+        grp_browse->align(FL_ALIGN_TOP | FL_ALIGN_LEFT);
+        grp_browse->begin();
+        int current_y = padding * 2 + widget_h;
+        Fl_Input* in_file_browse = new Fl_Input(padding + label_w, current_y, input_w, widget_h, "Archive:");
+        in_file_browse->align(FL_ALIGN_LEFT);
+        in_file_browse->color(COLOR_INPUT_BG);
+        in_file_browse->textcolor(COLOR_TEXT_DARK);
+        in_file_browse->labelcolor(COLOR_TEXT_DARK);
+        in_file_browse->when(FL_WHEN_ENTER_KEY); // 回车打开
+        in_file_browse->callback(open_input_cb);
+        Fl_Button* btn_browse_file_browse = new Fl_Button(in_file_browse->x() + input_w + padding, current_y, browse_w, widget_h, "Browse...");
+        btn_browse_file_browse->box(FL_GLEAM_UP_BOX);
+        btn_browse_file_browse->color(COLOR_SECONDARY);
+        btn_browse_file_browse->labelcolor(COLOR_TEXT_LIGHT);
+        btn_browse_file_browse->callback(browse_open_cb, in_file_browse);
+
+        current_y += widget_h + padding;
+        const int table_h = tabs_h - current_y - button_h - padding;
+        entry_table = new EntryTable(padding * 2, current_y, win_w - padding * 4, table_h);
+
+        current_y += table_h + padding / 2;
+        Fl_Button* btn_preview = new Fl_Button(grp_browse->w() / 2 - button_w - padding, current_y, button_w, button_h, "Preview");
+        btn_preview->box(FL_GLEAM_UP_BOX);
+        btn_preview->color(COLOR_PRIMARY);
+        btn_preview->labelcolor(COLOR_TEXT_LIGHT);
+        btn_preview->labelfont(FL_BOLD);
+        btn_preview->callback(preview_entry_cb);
+        Fl_Button* btn_export = new Fl_Button(grp_browse->w() / 2 + padding, current_y, button_w, button_h, "Export...");
+        btn_export->box(FL_GLEAM_UP_BOX);
+        btn_export->color(COLOR_PRIMARY);
+        btn_export->labelcolor(COLOR_TEXT_LIGHT);
+        btn_export->labelfont(FL_BOLD);
+        btn_export->callback(export_entry_cb);
+        grp_browse->end();
+    }
+
     tabs->end();
 
+    // --- Progress Area ---
+    progress_bar = new Fl_Progress(padding, progress_y, win_w - padding * 3 - browse_w, widget_h);
+    progress_bar->color(COLOR_INPUT_BG);
+    progress_bar->selection_color(COLOR_SUCCESS);
+    progress_bar->labelcolor(COLOR_TEXT_DARK);
+    cancel_button = new Fl_Button(win_w - padding - browse_w, progress_y, browse_w, widget_h, "取消");
+    cancel_button->box(FL_GLEAM_UP_BOX);
+    cancel_button->color(COLOR_WARNING);
+    cancel_button->labelcolor(COLOR_TEXT_LIGHT);
+    cancel_button->callback(cancel_jobs_cb);
+
     // --- Output Area ---
     output_buffer = new Fl_Text_Buffer();
     output_display = new Fl_Text_Display(padding, output_y, win_w - padding * 2, output_h, "Output");
@@ -439,10 +845,9 @@ int main(int argc, char **argv) {
 
     window->end();
     window->resizable(output_display); // Allow resizing, affecting the output area
+    update_progress();
+    Fl::lock(); // 工作线程通过Fl::awake把输出交给界面线程
     window->show(argc, argv);
-    
-    // 程序启动后检查可执行文件
-    check_executables();
 
     return Fl::run();
 }
\ No newline at end of file
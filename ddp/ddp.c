@@ -0,0 +1,858 @@
+/*
+dat文件的命令行工具，按子命令操作，DDP2/DDP3都按文件头识别，在同一个进程中处理：
+ddp unpack [-o 目录] [-j N] <dat|目录|通配符>...  解包，所有封包的条目共用一组线程
+ddp pack [-o out.dat] [-d 目录] archive.dat       按原封包的索引把解包目录打包
+ddp list archive.dat                 列出条目
+ddp cat archive.dat <序号|文件名>    只解出一个条目，输出到标准输出
+ddp verify archive.dat...            用带边界检查的解压校验全部条目
+ddp bench [-n 轮数] archive.dat...   测量解包到内存的速度
+ddp diff old.dat new.dat [patch]     生成差分补丁，不指定patch时输出到标准输出
+ddp apply old.dat patch out.dat      应用差分补丁
+ddp layout [-type|-name|-replay 列表] archive.dat out  生成打包时用的条目布局
+输出数据时提示信息都写到stderr
+*/
+#define _CRT_SECURE_NO_WARNINGS
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#ifdef _WIN32
+#include <io.h>
+#include <fcntl.h>
+#include <Windows.h>
+#else
+#include <dirent.h>
+#include <strings.h>
+#include <time.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+#include "ddp.h"
+
+#define MAX_NAME 260
+
+int WriteFileSink(void *ctx, const void *data, unit32 len)
+{
+	return fwrite(data, len, 1, (FILE *)ctx) == 1;
+}
+
+void BinaryStdout(void)
+{
+#ifdef _WIN32
+	_setmode(_fileno(stdout), _O_BINARY);
+#endif
+}
+
+//把命令行参数转成UTF-16LE的文件名，返回字节数
+unit32 ArgToName(const char *arg, unit16 *name)
+{
+#ifdef _WIN32
+	int len = MultiByteToWideChar(CP_ACP, 0, arg, -1, (WCHAR *)name, MAX_NAME);
+	return len > 0 ? (len - 1) * 2 : 0;
+#else
+	//其他平台按UTF-8解码
+	unit32 n = 0, c;
+	const unit8 *p = (const unit8 *)arg;
+	while (*p != 0 && n < MAX_NAME - 2)
+	{
+		if (*p < 0x80)
+			c = *p++;
+		else if ((*p & 0xE0) == 0xC0 && p[1] != 0)
+		{
+			c = (p[0] & 0x1F) << 6 | (p[1] & 0x3F);
+			p += 2;
+		}
+		else if ((*p & 0xF0) == 0xE0 && p[1] != 0 && p[2] != 0)
+		{
+			c = (p[0] & 0x0F) << 12 | (p[1] & 0x3F) << 6 | (p[2] & 0x3F);
+			p += 3;
+		}
+		else if ((*p & 0xF8) == 0xF0 && p[1] != 0 && p[2] != 0 && p[3] != 0)
+		{
+			c = (p[0] & 0x07) << 18 | (p[1] & 0x3F) << 12 | (p[2] & 0x3F) << 6 | (p[3] & 0x3F);
+			p += 4;
+		}
+		else
+		{
+			c = '?';
+			p++;
+		}
+		if (c >= 0x10000)
+		{
+			name[n++] = (unit16)(0xD800 | (c - 0x10000) >> 10);
+			c = 0xDC00 | (c & 0x3FF);
+		}
+		name[n++] = (unit16)c;
+	}
+	return n * 2;
+#endif
+}
+
+//DDP3的文件名(UTF-16LE)转成命令行的编码，用于输出
+void NameToArg(const struct ddp_entry *e, char *arg, unit32 size)
+{
+	unit16 name[MAX_NAME];
+	unit32 n = e->namelen / 2 < MAX_NAME - 1 ? e->namelen / 2 : MAX_NAME - 1;
+	memcpy(name, e->name, n * 2);
+	name[n] = 0;
+#ifdef _WIN32
+	if (WideCharToMultiByte(CP_ACP, 0, (WCHAR *)name, -1, arg, size, NULL, NULL) == 0)
+		arg[0] = 0;
+#else
+	unit32 k, c, len = 0;
+	for (k = 0; k < n && name[k] != 0 && len + 5 < size; k++)
+	{
+		c = name[k];
+		if (c >= 0xD800 && c < 0xDC00 && k + 1 < n)
+			c = 0x10000 + ((c - 0xD800) << 10) + (name[++k] & 0x3FF);
+		if (c < 0x80)
+			arg[len++] = (char)c;
+		else if (c < 0x800)
+		{
+			arg[len++] = (char)(0xC0 | c >> 6);
+			arg[len++] = (char)(0x80 | (c & 0x3F));
+		}
+		else if (c < 0x10000)
+		{
+			arg[len++] = (char)(0xE0 | c >> 12);
+			arg[len++] = (char)(0x80 | (c >> 6 & 0x3F));
+			arg[len++] = (char)(0x80 | (c & 0x3F));
+		}
+		else
+		{
+			arg[len++] = (char)(0xF0 | c >> 18);
+			arg[len++] = (char)(0x80 | (c >> 12 & 0x3F));
+			arg[len++] = (char)(0x80 | (c >> 6 & 0x3F));
+			arg[len++] = (char)(0x80 | (c & 0x3F));
+		}
+	}
+	arg[len] = 0;
+#endif
+}
+
+//DDP3先按文件名查找，解包出的文件名带有扩展名时去掉再找一次；都找不到或者是DDP2时按序号
+//序号后面可以带扩展名，即DDP2解包出的文件名
+unit32 FindEntry(ddp_archive *ar, char *key)
+{
+	unit16 name[MAX_NAME];
+	unit32 len, i;
+	char *end, *dot;
+	if (ddp_archive_format(ar) == DDP_FORMAT_DDP3)
+	{
+		len = ArgToName(key, name);
+		i = ddp_find_entry(ar, (unit8 *)name, len);
+		if (i != DDP_NOT_FOUND)
+			return i;
+		dot = strrchr(key, '.');
+		if (dot != NULL)
+		{
+			*dot = 0;
+			len = ArgToName(key, name);
+			*dot = '.';
+			i = ddp_find_entry(ar, (unit8 *)name, len);
+			if (i != DDP_NOT_FOUND)
+				return i;
+		}
+	}
+	i = strtoul(key, &end, 10);
+	if (end == key || (*end != 0 && *end != '.') || i >= ddp_entry_count(ar))
+		return DDP_NOT_FOUND;
+	return i;
+}
+
+int Cat(char *fname, char *key)
+{
+	ddp_archive *ar;
+	struct ddp_entry e;
+	unit8 *data, *owned;
+	unit32 i;
+	int err;
+	ar = ddp_open(fname, &err);
+	if (ar == NULL)
+	{
+		fprintf(stderr, "%s: %s!。\n", fname, ddp_strerror(err));
+		return 1;
+	}
+	i = FindEntry(ar, key);
+	if (i == DDP_NOT_FOUND)
+	{
+		fprintf(stderr, "%s中没有%s!。\n", fname, key);
+		ddp_close(ar);
+		return 1;
+	}
+	ddp_get_entry(ar, i, &e);
+	data = ddp_load_decrypted(ar, i, &owned);
+	if (data == NULL)
+	{
+		fprintf(stderr, "第%d个条目%s!。\n", i, ddp_strerror(DDP_ERR_READ));
+		ddp_close(ar);
+		return 1;
+	}
+	BinaryStdout();
+	err = e.uncomprlen != 0 && fwrite(data, e.uncomprlen, 1, stdout) != 1;
+	fflush(stdout);
+	free(owned);
+	ddp_close(ar);
+	return err;
+}
+
+int Diff(char *oldname, char *newname, char *patchname)
+{
+	struct ddp_delta_stats stats;
+	FILE *fp;
+	int err;
+	if (patchname != NULL)
+		fp = fopen(patchname, "wb");
+	else
+	{
+		BinaryStdout();
+		fp = stdout;
+	}
+	if (fp == NULL)
+	{
+		fprintf(stderr, "%s: %s!。\n", patchname, ddp_strerror(DDP_ERR_OPEN));
+		return 1;
+	}
+	setvbuf(fp, NULL, _IOFBF, 1 << 20);
+	err = ddp_delta_create(oldname, newname, WriteFileSink, fp, &stats);
+	if (fflush(fp) != 0 && err == DDP_OK)
+		err = DDP_ERR_WRITE;
+	if (fp != stdout)
+		fclose(fp);
+	if (err != DDP_OK)
+	{
+		fprintf(stderr, "%s!。\n", ddp_strerror(err));
+		if (patchname != NULL)
+			remove(patchname);
+		return 1;
+	}
+	fprintf(stderr, "未改动:%d 改动:%d 新增:%d 删除:%d 补丁大小:0x%X\n", stats.same, stats.changed, stats.added, stats.removed, stats.size);
+	return 0;
+}
+
+int Apply(char *oldname, char *patchname, char *outname)
+{
+	int err = ddp_delta_apply(oldname, patchname, outname);
+	if (err != DDP_OK)
+	{
+		fprintf(stderr, "%s!。\n", ddp_strerror(err));
+		return 1;
+	}
+	fprintf(stderr, "已生成%s\n", outname);
+	return 0;
+}
+
+struct name_list
+{
+	char **names;
+	unit32 num;
+	unit32 max;
+};
+
+void AddName(struct name_list *list, const char *dir, const char *name)
+{
+	char **p;
+	size_t len = dir != NULL ? strlen(dir) + 1 : 0;
+	if (list->num == list->max)
+	{
+		list->max = list->max ? list->max * 2 : 16;
+		p = realloc(list->names, list->max * sizeof(char *));
+		if (p == NULL)
+			return;
+		list->names = p;
+	}
+	p = &list->names[list->num];
+	*p = malloc(len + strlen(name) + 1);
+	if (*p == NULL)
+		return;
+	if (dir != NULL)
+		sprintf(*p, "%s/%s", dir, name);
+	else
+		strcpy(*p, name);
+	list->num++;
+}
+
+//目录展开为其中的*.dat，Windows下的通配符由这里展开(其他平台由shell展开)
+void ExpandArg(struct name_list *list, const char *arg)
+{
+#ifdef _WIN32
+	WIN32_FIND_DATAA fd;
+	HANDLE find;
+	char pattern[MAX_PATH], dir[MAX_PATH], *slash;
+	DWORD attr = GetFileAttributesA(arg);
+	if (attr != INVALID_FILE_ATTRIBUTES && (attr & FILE_ATTRIBUTE_DIRECTORY))
+	{
+		_snprintf(pattern, MAX_PATH, "%s\\*.dat", arg);
+		strcpy(dir, arg);
+	}
+	else if (strpbrk(arg, "*?") != NULL)
+	{
+		strncpy(pattern, arg, MAX_PATH - 1);
+		pattern[MAX_PATH - 1] = 0;
+		strcpy(dir, pattern);
+		slash = strrchr(dir, '\\') > strrchr(dir, '/') ? strrchr(dir, '\\') : strrchr(dir, '/');
+		if (slash != NULL)
+			*slash = 0;
+		else
+			strcpy(dir, ".");
+	}
+	else
+	{
+		AddName(list, NULL, arg);
+		return;
+	}
+	find = FindFirstFileA(pattern, &fd);
+	if (find == INVALID_HANDLE_VALUE)
+		return;
+	do
+	{
+		if (!(fd.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY))
+			AddName(list, dir, fd.cFileName);
+	} while (FindNextFileA(find, &fd));
+	FindClose(find);
+#else
+	DIR *d;
+	struct dirent *de;
+	struct stat st;
+	size_t len;
+	if (stat(arg, &st) != 0 || !S_ISDIR(st.st_mode))
+	{
+		AddName(list, NULL, arg);
+		return;
+	}
+	d = opendir(arg);
+	if (d == NULL)
+		return;
+	while ((de = readdir(d)) != NULL)
+	{
+		len = strlen(de->d_name);
+		if (len > 4 && strcasecmp(de->d_name + len - 4, ".dat") == 0)
+			AddName(list, arg, de->d_name);
+	}
+	closedir(d);
+#endif
+}
+
+int CompareName(const void *a, const void *b)
+{
+	return strcmp(*(char *const *)a, *(char *const *)b);
+}
+
+unit32 CpuCount(void)
+{
+#ifdef _WIN32
+	SYSTEM_INFO info;
+	GetSystemInfo(&info);
+	return info.dwNumberOfProcessors;
+#else
+	long n = sysconf(_SC_NPROCESSORS_ONLN);
+	return n > 0 ? (unit32)n : 1;
+#endif
+}
+
+double Now(void)
+{
+#ifdef _WIN32
+	LARGE_INTEGER freq, count;
+	QueryPerformanceFrequency(&freq);
+	QueryPerformanceCounter(&count);
+	return (double)count.QuadPart / freq.QuadPart;
+#else
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+#endif
+}
+
+//各子命令共用的参数
+struct options
+{
+	unit32 threads;
+	int stats;//--stats
+	char *trace;//--trace out.json
+	char *out;//-o
+};
+
+//能识别时返回1，*i指向最后一个用掉的参数
+int ParseOption(struct options *opt, int argc, char *argv[], int *i)
+{
+	if (strcmp(argv[*i], "-j") == 0 && *i + 1 < argc)
+	{
+		opt->threads = atoi(argv[++*i]);
+		if (opt->threads == 0)
+			opt->threads = CpuCount();
+	}
+	else if (strcmp(argv[*i], "-o") == 0 && *i + 1 < argc)
+		opt->out = argv[++*i];
+	else if (strcmp(argv[*i], "--stats") == 0)
+		opt->stats = 1;
+	else if (strcmp(argv[*i], "--trace") == 0 && *i + 1 < argc)
+	{
+		opt->stats = 1;
+		opt->trace = argv[++*i];
+	}
+	else
+		return 0;
+	return 1;
+}
+
+void PrintStats(ddp_stats *stats, struct options *opt)
+{
+	if (stats == NULL)
+		return;
+	ddp_stats_print(stats, stderr);
+	if (opt->trace != NULL)
+	{
+		if (ddp_stats_write_trace(stats, opt->trace) == DDP_OK)
+			fprintf(stderr, "trace已写入%s\n", opt->trace);
+		else
+			fprintf(stderr, "%s: %s!。\n", opt->trace, ddp_strerror(DDP_ERR_WRITE));
+	}
+	ddp_stats_free(stats);
+}
+
+//解包列出的全部封包，不暂停，最后输出每个封包的结果；有封包失败时返回1
+//-o只能用于一个封包，指定输出目录，否则为各自的<dat>_unpack
+int Unpack(int argc, char *argv[])
+{
+	struct name_list list;
+	struct options opt;
+	struct ddp_unpack_params params;
+	struct ddp_unpack_result *results;
+	ddp_archive **ars;
+	unit32 a, total = 0, failed = 0;
+	int i, *open_err;
+	memset(&list, 0, sizeof(list));
+	memset(&opt, 0, sizeof(opt));
+	memset(&params, 0, sizeof(params));
+	opt.threads = 1;
+	for (i = 0; i < argc; i++)
+	{
+		if (ParseOption(&opt, argc, argv, &i))
+			continue;
+		else
+		{
+			a = list.num;
+			ExpandArg(&list, argv[i]);
+			//同一个目录中的封包按文件名排序，输出顺序固定
+			qsort(list.names + a, list.num - a, sizeof(char *), CompareName);
+		}
+	}
+	if (list.num == 0)
+	{
+		fprintf(stderr, "没有找到dat文件!。\n");
+		return 1;
+	}
+	if (opt.out != NULL && list.num > 1)
+	{
+		fprintf(stderr, "-o只能用于一个封包!。\n");
+		return 1;
+	}
+	params.threads = opt.threads;
+	params.outdirs = opt.out != NULL ? (const char *const *)&opt.out : NULL;
+	ars = calloc(list.num, sizeof(ddp_archive *));
+	open_err = calloc(list.num, sizeof(int));
+	results = calloc(list.num, sizeof(struct ddp_unpack_result));
+	if (ars == NULL || open_err == NULL || results == NULL)
+	{
+		fprintf(stderr, "%s!。\n", ddp_strerror(DDP_ERR_NOMEM));
+		return 1;
+	}
+	for (a = 0; a < list.num; a++)
+	{
+		ars[a] = ddp_open(list.names[a], &open_err[a]);
+		if (ars[a] != NULL)
+			total += ddp_entry_count(ars[a]);
+	}
+	fprintf(stderr, "%d个封包，共%d个条目，%d个线程\n", list.num, total, params.threads);
+	if (opt.stats)
+		params.stats = ddp_stats_create(total, opt.trace != NULL);
+	ddp_unpack_archives(ars, (const char **)list.names, list.num, &params, results);
+	for (a = 0; a < list.num; a++)
+	{
+		if (ars[a] == NULL)
+			fprintf(stderr, "%s: %s!。\n", list.names[a], ddp_strerror(open_err[a]));
+		else
+		{
+			fprintf(stderr, "%s: DDP%d 条目:%d 共用数据区:%d 失败:%d 解包:%.1fMB%s%s\n", list.names[a], ddp_archive_format(ars[a]), results[a].count, results[a].shared, results[a].failed, results[a].bytes / 1048576.0,
+				results[a].err != DDP_OK ? " " : "", results[a].err != DDP_OK ? ddp_strerror(results[a].err) : "");
+			if (results[a].manifest_err)
+				fprintf(stderr, "\t清单%s写入失败，打包时将改为读取原条目判断类型\n", DDP_MANIFEST_NAME);
+		}
+		if (ars[a] == NULL || results[a].err != DDP_OK)
+			failed++;
+		ddp_close(ars[a]);
+		free(list.names[a]);
+	}
+	fprintf(stderr, "已完成，成功%d个，失败%d个\n", list.num - failed, failed);
+	PrintStats(params.stats, &opt);
+	free(ars);
+	free(open_err);
+	free(results);
+	free(list.names);
+	return failed != 0;
+}
+
+int Usage(void)
+{
+	fprintf(stderr, "DDP命令行工具，DDP2/DDP3按文件头识别\n"
+		"用法：ddp unpack [-o 目录] [-j N] [--stats] [--trace out.json] <dat|目录|通配符>...\n"
+		"      ddp pack [-o out.dat] [-d 目录] [-store|-fast|-lazy|-optimal] [-inc|-patch|-compact] [-dedup] [-layout type|name|布局文件] [-j N] [--stats] archive.dat\n"
+		"      ddp list archive.dat\n"
+		"      ddp cat archive.dat <序号|文件名>\n"
+		"      ddp verify archive.dat...\n"
+		"      ddp bench [-n 轮数] archive.dat...\n"
+		"      ddp layout [-type|-name|-replay 读取列表] archive.dat 布局文件\n"
+		"      ddp diff old.dat new.dat [patch] (不指定patch时输出到标准输出)\n"
+		"      ddp apply old.dat patch out.dat\n");
+	return 1;
+}
+
+//去掉-patch留下的废弃数据，清单中的封包大小随之更新
+int Compact(char *fname, char *dir)
+{
+	unit32 saved;
+	int err = ddp_pack_compact(fname, dir, &saved);
+	if (err != DDP_OK)
+		fprintf(stderr, "%s: %s!。\n", fname, ddp_strerror(err));
+	else
+		fprintf(stderr, "%s 整理完成，回收了0x%X字节\n", fname, saved);
+	return err != DDP_OK;
+}
+
+//按原封包的索引把解包目录打包，-o指定输出文件(默认<dat>_new)，-d指定解包目录(默认<dat>_unpack)
+int Pack(int argc, char *argv[])
+{
+	struct options opt;
+	struct ddp_pack_params params;
+	ddp_archive *ar;
+	char *fname = NULL, *dir = NULL, *outname, *layout = NULL;
+	unit32 *order = NULL;
+	int i, err, compact = 0;
+	memset(&opt, 0, sizeof(opt));
+	memset(&params, 0, sizeof(params));
+	opt.threads = 1;
+	params.level = DDP_LEVEL_LAZY;
+	for (i = 0; i < argc; i++)
+	{
+		if (ParseOption(&opt, argc, argv, &i))
+			continue;
+		if (strcmp(argv[i], "-store") == 0)
+			params.level = DDP_LEVEL_STORE;
+		else if (strcmp(argv[i], "-fast") == 0)
+			params.level = DDP_LEVEL_FAST;
+		else if (strcmp(argv[i], "-lazy") == 0)
+			params.level = DDP_LEVEL_LAZY;
+		else if (strcmp(argv[i], "-optimal") == 0)
+			params.level = DDP_LEVEL_OPTIMAL;
+		else if (strcmp(argv[i], "-inc") == 0)
+			params.incremental = 1;
+		else if (strcmp(argv[i], "-dedup") == 0)
+			params.dedup = 1;
+		else if (strcmp(argv[i], "-layout") == 0 && i + 1 < argc)
+			layout = argv[++i];
+		else if (strcmp(argv[i], "-patch") == 0)
+			params.patch = 1;
+		else if (strcmp(argv[i], "-compact") == 0)
+			compact = 1;
+		else if (strcmp(argv[i], "-d") == 0 && i + 1 < argc)
+			dir = argv[++i];
+		else if (fname == NULL)
+			fname = argv[i];
+	}
+	if (fname == NULL)
+		return Usage();
+	if (compact)
+		return Compact(fname, dir);
+	ar = ddp_open(fname, &err);
+	if (ar == NULL)
+	{
+		fprintf(stderr, "%s: %s!。\n", fname, ddp_strerror(err));
+		return 1;
+	}
+	//-layout为type、name时按规则生成，否则为ddp layout写出的布局文件
+	if (layout != NULL && !params.patch)
+	{
+		if (strcmp(layout, "type") == 0 || strcmp(layout, "name") == 0)
+			order = ddp_layout_guess(ar, strcmp(layout, "type") == 0 ? DDP_LAYOUT_TYPE : DDP_LAYOUT_NAME);
+		else
+			order = ddp_layout_read(layout, ar);
+		if (order == NULL)
+		{
+			fprintf(stderr, "%s: 布局文件不存在或与封包不符!。\n", layout);
+			ddp_close(ar);
+			return 1;
+		}
+		params.order = order;
+	}
+	outname = opt.out;
+	if (outname == NULL && !params.patch)
+	{
+		outname = malloc(strlen(fname) + 5);
+		sprintf(outname, "%s_new", fname);
+	}
+	params.threads = opt.threads;
+	if (opt.stats)
+		params.stats = ddp_stats_create(ddp_entry_count(ar), opt.trace != NULL);
+	err = ddp_pack_archive(ar, fname, dir, outname, &params);
+	if (!params.has_manifest)
+		fprintf(stderr, "没有找到有效的清单%s，已读取原条目判断类型\n", DDP_MANIFEST_NAME);
+	if (err == DDP_ERR_PATCH)
+		fprintf(stderr, "-patch需要解包时写出的清单%s!。\n", DDP_MANIFEST_NAME);
+	else if (err != DDP_OK && params.missing != DDP_NOT_FOUND)
+		fprintf(stderr, "第%d个条目的文件%s!。\n", params.missing, ddp_strerror(DDP_ERR_OPEN));
+	else if (err != DDP_OK)
+		fprintf(stderr, "%s!。\n", ddp_strerror(err));
+	else
+	{
+		fprintf(stderr, "%s: DDP%d 条目:%d 未改动:%d file_size:0x%X\n", params.patch ? fname : outname, ddp_archive_format(ar), ddp_entry_count(ar), params.kept, params.filesize);
+		if (params.dedup && !params.patch)
+			fprintf(stderr, "相同的条目共用数据区，省下0x%X字节\n", params.saved);
+	}
+	PrintStats(params.stats, &opt);
+	if (outname != opt.out)
+		free(outname);
+	free(order);
+	ddp_close(ar);
+	return err != DDP_OK;
+}
+
+//生成布局文件，供ddp pack -layout使用
+//-replay时按列表(每行一个序号或文件名，例如游戏读取封包的日志)经过读取接口依次读取，记录下的读取顺序即为布局
+//否则按-type(默认)或-name的规则生成
+int Layout(int argc, char *argv[])
+{
+	ddp_archive *ar;
+	const unit32 *access;
+	unit32 *order = NULL, i, num, missing = 0;
+	unit8 *data, *owned;
+	char *fname = NULL, *outname = NULL, *replay = NULL, line[1024];
+	FILE *fp;
+	int k, err, mode = DDP_LAYOUT_TYPE;
+	for (k = 0; k < argc; k++)
+	{
+		if (strcmp(argv[k], "-type") == 0)
+			mode = DDP_LAYOUT_TYPE;
+		else if (strcmp(argv[k], "-name") == 0)
+			mode = DDP_LAYOUT_NAME;
+		else if (strcmp(argv[k], "-replay") == 0 && k + 1 < argc)
+			replay = argv[++k];
+		else if (fname == NULL)
+			fname = argv[k];
+		else
+			outname = argv[k];
+	}
+	if (fname == NULL || outname == NULL)
+		return Usage();
+	ar = ddp_open(fname, &err);
+	if (ar == NULL)
+	{
+		fprintf(stderr, "%s: %s!。\n", fname, ddp_strerror(err));
+		return 1;
+	}
+	if (replay != NULL)
+	{
+		fp = fopen(replay, "r");
+		if (fp == NULL || ddp_record_access(ar) != DDP_OK)
+		{
+			fprintf(stderr, "%s: %s!。\n", replay, ddp_strerror(fp == NULL ? DDP_ERR_OPEN : DDP_ERR_NOMEM));
+			if (fp != NULL)
+				fclose(fp);
+			ddp_close(ar);
+			return 1;
+		}
+		while (fgets(line, sizeof(line), fp) != NULL)
+		{
+			line[strcspn(line, "\r\n")] = 0;
+			if (line[0] == 0)
+				continue;
+			i = FindEntry(ar, line);
+			if (i == DDP_NOT_FOUND)
+			{
+				missing++;
+				continue;
+			}
+			data = ddp_load_decrypted(ar, i, &owned);
+			if (data == NULL)
+				fprintf(stderr, "第%d个条目%s!。\n", i, ddp_strerror(DDP_ERR_READ));
+			free(owned);
+		}
+		fclose(fp);
+		num = ddp_recorded_access(ar, &access);
+		if (missing != 0)
+			fprintf(stderr, "%d行在%s中没有找到，已跳过\n", missing, fname);
+		fprintf(stderr, "记录了%d个条目的读取顺序，其余%d个条目按序号放在后面\n", num, ddp_entry_count(ar) - num);
+	}
+	else
+	{
+		order = ddp_layout_guess(ar, mode);
+		access = order;
+		num = order != NULL ? ddp_entry_count(ar) : 0;
+	}
+	err = replay != NULL || order != NULL ? ddp_layout_write(outname, ar, access, num) : DDP_ERR_NOMEM;
+	if (err != DDP_OK)
+		fprintf(stderr, "%s: %s!。\n", outname, ddp_strerror(err));
+	free(order);
+	ddp_close(ar);
+	return err != DDP_OK;
+}
+
+//每行一个条目：序号、偏移、压缩后和解压后的长度、类型，DDP3还有文件名
+int List(char *fname)
+{
+	ddp_archive *ar;
+	struct ddp_iter it;
+	const struct ddp_entry *e;
+	char name[MAX_NAME * 3];
+	int err;
+	ar = ddp_open(fname, &err);
+	if (ar == NULL)
+	{
+		fprintf(stderr, "%s: %s!。\n", fname, ddp_strerror(err));
+		return 1;
+	}
+	fprintf(stderr, "%s: DDP%d 条目:%d\n", fname, ddp_archive_format(ar), ddp_entry_count(ar));
+	ddp_iter_begin(&it, ar);
+	while ((e = ddp_iter_next(&it)) != NULL)
+	{
+		printf("%u\t0x%X\t0x%X\t0x%X\t%s", it.next - 1, e->offset, e->comprlen, e->uncomprlen, ddp_type_ext(ddp_entry_type(ar, it.next - 1)));
+		if (e->name != NULL)
+		{
+			NameToArg(e, name, sizeof(name));
+			printf("\t%s", name);
+		}
+		printf("\n");
+	}
+	ddp_close(ar);
+	return 0;
+}
+
+//用带边界检查的解压逐个解出条目，数据损坏时报告条目和错误，不会越界
+int Verify(int argc, char *argv[])
+{
+	ddp_archive *ar;
+	struct ddp_entry e;
+	unit8 *compr, *uncompr;
+	unit32 i, maxlen, maxclen, bad, failed = 0;
+	int k, err;
+	for (k = 0; k < argc; k++)
+	{
+		ar = ddp_open(argv[k], &err);
+		if (ar == NULL)
+		{
+			fprintf(stderr, "%s: %s!。\n", argv[k], ddp_strerror(err));
+			failed++;
+			continue;
+		}
+		ddp_max_lengths(ar, &maxlen, &maxclen);
+		compr = malloc((size_t)(maxclen > maxlen ? maxclen : maxlen) + 1);
+		uncompr = malloc((size_t)maxlen + 1);
+		bad = 0;
+		for (i = 0; i < ddp_entry_count(ar) && compr != NULL && uncompr != NULL; i++)
+		{
+			ddp_get_entry(ar, i, &e);
+			err = ddp_read_raw(ar, i, compr, e.comprlen != 0 ? e.comprlen : e.uncomprlen);
+			if (err == DDP_OK && e.comprlen != 0)
+				err = ddp_uncompress_safe(uncompr, e.uncomprlen, compr, e.comprlen);
+			if (err != DDP_OK)
+			{
+				fprintf(stderr, "\t第%d个条目 offset:0x%X %s\n", i, e.offset, ddp_strerror(err));
+				bad++;
+			}
+		}
+		if (compr == NULL || uncompr == NULL)
+		{
+			fprintf(stderr, "%s: %s!。\n", argv[k], ddp_strerror(DDP_ERR_NOMEM));
+			bad++;
+		}
+		else
+			fprintf(stderr, "%s: DDP%d 条目:%d 损坏:%d\n", argv[k], ddp_archive_format(ar), ddp_entry_count(ar), bad);
+		if (bad != 0)
+			failed++;
+		free(compr);
+		free(uncompr);
+		ddp_close(ar);
+	}
+	return failed != 0;
+}
+
+//把全部条目解压(HXB同时解密)到内存，取多轮中最快的一次；合成数据的测试见DDP_bench -gen
+int Bench(int argc, char *argv[])
+{
+	ddp_archive *ar;
+	struct ddp_entry e;
+	unit8 *buf;
+	unit32 i, maxlen, maxclen;
+	unsigned long long bytes;
+	double start, best;
+	int k, r, rounds = 5, err, failed = 0;
+	for (k = 0; k < argc; k++)
+	{
+		if (strcmp(argv[k], "-n") == 0 && k + 1 < argc)
+		{
+			rounds = atoi(argv[++k]);
+			if (rounds < 1)
+				rounds = 1;
+			continue;
+		}
+		ar = ddp_open(argv[k], &err);
+		if (ar == NULL)
+		{
+			fprintf(stderr, "%s: %s!。\n", argv[k], ddp_strerror(err));
+			failed++;
+			continue;
+		}
+		ddp_max_lengths(ar, &maxlen, &maxclen);
+		buf = malloc((size_t)maxlen + maxclen + 1);
+		best = 0;
+		bytes = 0;
+		for (r = 0; r < rounds && buf != NULL; r++)
+		{
+			bytes = 0;
+			start = Now();
+			for (i = 0; i < ddp_entry_count(ar); i++)
+			{
+				if (ddp_load_into(ar, i, buf, maxlen + maxclen) == NULL)
+					break;
+				bytes += ddp_get_entry(ar, i, &e)->uncomprlen;
+			}
+			if (i != ddp_entry_count(ar))
+				break;
+			start = Now() - start;
+			if (r == 0 || start < best)
+				best = start;
+		}
+		if (buf == NULL || r != rounds)
+		{
+			fprintf(stderr, "%s: %s!。\n", argv[k], ddp_strerror(buf == NULL ? DDP_ERR_NOMEM : DDP_ERR_READ));
+			failed++;
+		}
+		else
+			printf("%s: DDP%d 条目:%d 解包%.1fMB %.1f MB/s\n", argv[k], ddp_archive_format(ar), ddp_entry_count(ar), bytes / 1048576.0, best > 0 ? bytes / 1048576.0 / best : 0);
+		free(buf);
+		ddp_close(ar);
+	}
+	return failed != 0;
+}
+
+int main(int argc, char *argv[])
+{
+	if (argc >= 4 && strcmp(argv[1], "cat") == 0)
+		return Cat(argv[2], argv[3]);
+	if (argc >= 4 && strcmp(argv[1], "diff") == 0)
+		return Diff(argv[2], argv[3], argc >= 5 ? argv[4] : NULL);
+	if (argc >= 5 && strcmp(argv[1], "apply") == 0)
+		return Apply(argv[2], argv[3], argv[4]);
+	if (argc >= 3 && strcmp(argv[1], "unpack") == 0)
+		return Unpack(argc - 2, argv + 2);
+	if (argc >= 3 && strcmp(argv[1], "pack") == 0)
+		return Pack(argc - 2, argv + 2);
+	if (argc >= 3 && strcmp(argv[1], "list") == 0)
+		return List(argv[2]);
+	if (argc >= 3 && strcmp(argv[1], "verify") == 0)
+		return Verify(argc - 2, argv + 2);
+	if (argc >= 3 && strcmp(argv[1], "bench") == 0)
+		return Bench(argc - 2, argv + 2);
+	if (argc >= 3 && strcmp(argv[1], "layout") == 0)
+		return Layout(argc - 2, argv + 2);
+	return Usage();
+}
@@ -0,0 +1,347 @@
+/*
+DDP2/DDP3封包的公共实现，供各个打包/解包工具和GUI共用
+所有状态都保存在ddp_archive句柄中，没有全局变量，可以在一个进程里同时处理多个封包
+*/
+#ifndef DDP_H
+#define DDP_H
+
+#include <stdio.h>
+
+typedef unsigned char  unit8;
+typedef unsigned short unit16;
+typedef unsigned int   unit32;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+enum
+{
+	DDP_OK = 0,
+	DDP_ERR_OPEN,//无法打开文件
+	DDP_ERR_MAGIC,//文件头不是DDP2/DDP3
+	DDP_ERR_FORMAT,//索引表损坏
+	DDP_ERR_READ,
+	DDP_ERR_WRITE,
+	DDP_ERR_NOMEM,
+	DDP_ERR_TRUNCATED,//压缩数据在解压完成前结束
+	DDP_ERR_OFFSET,//匹配的偏移超出已解压的数据
+	DDP_ERR_OVERFLOW,//解压结果超出uncomprlen
+	DDP_ERR_PATCH,//补丁损坏或与旧封包不符
+	DDP_ERR_CANCELLED,//被调用者取消
+	DDP_ERR_NAME,//DDP3文件名含有..、开头的分隔符或盘符
+	DDP_ERR_SAME_FILE//输出文件就是正在读取的封包
+};
+
+enum
+{
+	DDP_FORMAT_DDP2 = 2,
+	DDP_FORMAT_DDP3 = 3
+};
+
+enum
+{
+	DDP_LEVEL_STORE = 0,//不压缩
+	DDP_LEVEL_FAST,//贪心
+	DDP_LEVEL_LAZY,//惰性匹配
+	DDP_LEVEL_OPTIMAL//按编码长度做最优解析
+};
+
+enum
+{
+	DDP_TYPE_HXB = 0,
+	DDP_TYPE_BMP,
+	DDP_TYPE_PNG,
+	DDP_TYPE_TGA,
+	DDP_TYPE_BIN
+};
+
+#define DDP_SNIFF_LEN 16//ddp_sniff最多需要的字节数
+#define DDP_MANIFEST_NAME "ddp_manifest.txt"//解包目录中的清单文件名
+#define DDP_NOT_FOUND 0xFFFFFFFF//ddp_find_entry没有找到
+
+struct ddp_header
+{
+	unit8 magic[4];//DDP2或DDP3
+	unit32 num;//DDP2为文件数，DDP3为pack块数
+	unit32 file_offset;
+	unit32 filesize;//文件最后4字节
+};
+
+struct ddp_hxb_header
+{
+	unit8 magic[8];// DDWuHXB或者DDSxHXB
+	unit8 length[3];
+	unit8 flag;
+	unit32 unk;// 0
+};
+
+struct ddp_entry
+{
+	unit32 offset;
+	unit32 uncomprlen;
+	unit32 comprlen;//0表示未压缩
+	unit32 record;//索引记录在文件头中的位置
+	unit32 pack;//DDP3所在的pack块
+	unit8 len;//DDP3索引记录长度
+	const unit8 *name;//DDP3文件名，UTF-16LE且含结尾的0，指向封包的索引表，DDP2为NULL
+	unit32 namelen;//文件名字节数
+};
+
+//解包时记录的每个条目的信息，打包时用来判断解包出的文件是否改动过
+struct ddp_manifest_entry
+{
+	unit8 type;
+	unit32 size;//解包出的文件大小
+	long long mtime;//解包出的文件的修改时间
+	unsigned long long hash;//ddp_hash64(解包出的内容)
+};
+
+typedef struct ddp_archive ddp_archive;
+typedef struct ddp_stats ddp_stats;
+typedef struct ddp_bufpool ddp_bufpool;
+
+struct ddp_iter
+{
+	ddp_archive *ar;
+	unit32 next;
+	struct ddp_entry entry;//ddp_iter_next返回的就是它
+};
+
+//写封包时为第i个条目提供新内容(HXB需已加密)，失败返回NULL
+typedef unit8 *(*ddp_load_fn)(void *ctx, ddp_archive *ar, unit32 i, unit32 *len);
+//条目写入后回调，e为新的索引记录，data为load返回的缓冲，保留原数据的条目为NULL；由done负责释放data
+typedef void (*ddp_done_fn)(void *ctx, unit32 i, unit8 *data, const struct ddp_entry *e);
+
+//返回非0时第i个条目直接复制原封包中存储的数据，不解压也不重新压缩
+typedef int (*ddp_keep_fn)(void *ctx, ddp_archive *ar, unit32 i);
+//出错时释放load返回了但还没交给done的缓冲，done为NULL时也用来释放写出后的缓冲
+typedef void (*ddp_release_fn)(void *ctx, unit8 *data);
+//写封包的输出目标，写入len字节，失败返回0
+typedef int (*ddp_sink_fn)(void *ctx, const void *data, unit32 len);
+//不读入内容，返回第i个条目的新内容的长度，不知道时返回DDP_NOT_FOUND
+typedef unit32 (*ddp_size_fn)(void *ctx, ddp_archive *ar, unit32 i);
+
+//threads大于1时keep和load在工作线程中同时调用，需要可重入；done总是在调用线程中按存放的顺序依次调用
+struct ddp_write_params
+{
+	int level;
+	ddp_load_fn load;
+	ddp_done_fn done;//可以为NULL，此时写出后用release释放load返回的缓冲
+	ddp_keep_fn keep;//可以为NULL，此时所有条目都调用load
+	void *ctx;
+	unit32 threads;//压缩线程数，0或1时在调用线程中顺序压缩，输出与线程数无关
+	unit32 budget;//已压缩未写出的条目最多占用的内存，0为默认的64MB
+	struct ddp_stats *stats;//可以为NULL，否则记录keep、load、压缩和写出各阶段的耗时
+	ddp_release_fn release;//可以为NULL，此时用free释放
+	int dedup;//非0时存储的数据相同的条目共用同一块数据区，只写出一次；ddp_patch_archive忽略
+	const unit32 *order;//可以为NULL，否则为0到条目数-1的排列，数据区按这个顺序存放，索引中条目的顺序和文件名不变；ddp_patch_archive忽略
+	ddp_size_fn size;//可以为NULL，只有ddp_write_archive_to在DDP_LEVEL_STORE时用来预先确定条目的大小
+	unit32 filesize;//输出：新封包的大小
+	unit32 saved;//输出：共用数据区省下的字节数
+};
+
+void ddp_uncompress(unit8 *uncompr, unit32 uncomprlen, unit8 *compr, unit32 comprlen);
+//带边界检查的解压，每个token检查一次，数据损坏时返回DDP_ERR_TRUNCATED/OFFSET/OVERFLOW而不会越界读写
+int ddp_uncompress_safe(unit8 *uncompr, unit32 uncomprlen, unit8 *compr, unit32 comprlen);
+//只解压前len字节，最后一个token超出时截断，返回实际得到的字节数
+unit32 ddp_uncompress_partial(unit8 *uncompr, unit32 len, unit8 *compr, unit32 comprlen);
+void ddp_uncompress_ref(unit8 *uncompr, unit32 uncomprlen, unit8 *compr, unit32 comprlen);
+unit32 ddp_compress(unit8 *compr, unit32 comprlen, unit8 *uncompr, unit32 uncomprlen, int level);
+
+//data为整个HXB文件(含0x10字节的文件头)，len为其长度
+void ddp_hxb_decrypt(const struct ddp_hxb_header *header, unit8 *data, unit32 len);
+void ddp_hxb_encrypt(const struct ddp_hxb_header *header, unit8 *data, unit32 len);
+int ddp_sniff(const unit8 *data, unit32 len);
+const char *ddp_type_ext(int type);
+
+ddp_archive *ddp_open(const char *fname, int *err);
+void ddp_close(ddp_archive *ar);
+int ddp_archive_format(ddp_archive *ar);
+const struct ddp_header *ddp_archive_header(ddp_archive *ar);
+unit32 ddp_entry_count(ddp_archive *ar);
+//条目在库内按字段分数组存放，这里把第i个条目的各字段填入e，越界时返回NULL，否则返回e
+const struct ddp_entry *ddp_get_entry(ddp_archive *ar, unit32 i, struct ddp_entry *e);
+
+//按DDP3文件名(UTF-16LE，namelen为字节数，结尾的0可有可无)查找条目，返回序号
+//第一次调用时建立散列表，之后每次查找为O(1)；DDP2没有文件名，总是返回DDP_NOT_FOUND
+unit32 ddp_find_entry(ddp_archive *ar, const unit8 *name, unit32 namelen);
+
+void ddp_iter_begin(struct ddp_iter *it, ddp_archive *ar);
+const struct ddp_entry *ddp_iter_next(struct ddp_iter *it);
+
+//取得第i个条目解压后的数据，未压缩的条目在映射时直接指向映射的内存(只读)
+//*owned返回需要free的缓冲，可能为NULL；失败返回NULL
+unit8 *ddp_load_entry(ddp_archive *ar, unit32 i, unit8 **owned);
+//同上，但HXB条目在解压的同时解密
+unit8 *ddp_load_decrypted(ddp_archive *ar, unit32 i, unit8 **owned);
+//解压第i个条目(HXB同时解密)到buf，不分配内存，buflen至少为uncomprlen + comprlen
+//返回数据的位置：映射时未压缩且不用解密的条目直接指向映射的内存，其他情况为buf；失败返回NULL
+unit8 *ddp_load_into(ddp_archive *ar, unit32 i, unit8 *buf, unit32 buflen);
+//索引中最大的uncomprlen和comprlen，按它们分配一次缓冲就够所有条目使用
+void ddp_max_lengths(ddp_archive *ar, unit32 *uncomprlen, unit32 *comprlen);
+//解压第i个条目到调用者的缓冲，buflen至少为uncomprlen
+int ddp_read_entry(ddp_archive *ar, unit32 i, unit8 *buf, unit32 buflen);
+//读取第i个条目在封包中存储的原始数据(压缩的条目不解压)，buflen至少为comprlen或uncomprlen
+int ddp_read_raw(ddp_archive *ar, unit32 i, unit8 *buf, unit32 buflen);
+//只解压条目开头的DDP_SNIFF_LEN字节来判断类型
+int ddp_entry_type(ddp_archive *ar, unit32 i);
+//开始记录条目第一次被读取的顺序：之后ddp_load_*和ddp_read_*读取的每个条目按顺序记一次，可以在多个线程中读取
+int ddp_record_access(ddp_archive *ar);
+//返回已记录的条目数，*order指向记录(在ddp_close之前有效)；没有调用ddp_record_access时返回0
+unit32 ddp_recorded_access(ddp_archive *ar, const unit32 **order);
+//以ar为模板写出新封包，文件头和索引表沿用ar，条目内容由params->load提供
+//条目经过大块的写缓冲顺序写出，最后在文件开头一次写回索引表
+//outname与ar是同一个文件时返回DDP_ERR_SAME_FILE，不会截断正在读取的封包
+int ddp_write_archive(ddp_archive *ar, const char *outname, struct ddp_write_params *params);
+//在原封包上就地修补：params->keep返回0的条目追加到文件末尾，原地更新索引记录和文件大小
+//keep不能为NULL时才有意义；成功后ar的索引随之更新，但新追加的数据要重新打开封包才能读取
+int ddp_patch_archive(ddp_archive *ar, const char *fname, struct ddp_write_params *params);
+//去掉修补留下的废弃数据：重写为临时文件后替换原封包，相同的数据区只保留一份，*saved返回减少的字节数
+int ddp_compact_archive(const char *fname, unit32 *saved);
+//同上，但输出到不能回写的目标(如管道)，索引表总是在条目之前写出
+//不去重且条目大小都能预先确定(keep返回非0的条目沿用原大小，其他条目要DDP_LEVEL_STORE且size给出长度)时，先写出索引表，条目边处理边写出，只占用写缓冲
+//否则要把全部条目存储的数据暂存在内存里，占用的内存约为新封包的大小，全部处理完才开始写出
+int ddp_write_archive_to(ddp_archive *ar, ddp_sink_fn sink, void *sink_ctx, struct ddp_write_params *params);
+
+//ddp_unpack_archives每解包一个条目回调一次，a为封包的序号，type为判断出的类型，在工作线程中同时调用
+typedef void (*ddp_unpack_fn)(void *ctx, unit32 a, unit32 i, const struct ddp_entry *e, int type, int err);
+
+struct ddp_unpack_params
+{
+	unit32 threads;//所有封包共用的线程数，0或1时在调用线程中解包
+	const char *const *outdirs;//各封包的输出目录，为NULL时为<封包名>_unpack
+	ddp_unpack_fn done;//可以为NULL
+	void *ctx;
+	struct ddp_stats *stats;//可以为NULL，条目按封包的顺序接着编号
+	volatile int *cancel;//可以为NULL，其他线程置为非0后不再领取新的条目，没解完的封包返回DDP_ERR_CANCELLED且不写清单
+};
+
+struct ddp_unpack_result
+{
+	int err;//打开或建立目录失败，或者第一个失败的条目的错误
+	unit32 count;//条目数
+	unit32 failed;//解压或写出失败的条目数
+	unsigned long long bytes;//解包出的字节数
+	unit32 shared;//与前面的条目共用数据区、没有再解压的条目数
+	int manifest_err;//清单写入失败
+};
+
+//把多个封包解包到各自的目录并写出清单，ars中为NULL的封包跳过，results为每个封包的结果
+//所有封包的条目由同一组线程依次领取，小封包不会让线程空闲；有封包失败时返回其错误
+int ddp_unpack_archives(ddp_archive **ars, const char **fnames, unit32 num, struct ddp_unpack_params *params, struct ddp_unpack_result *results);
+
+//ddp_pack_archive每写出一个条目回调一次，kept非0时沿用了原数据；总是在调用线程中按存放的顺序调用
+typedef void (*ddp_pack_fn)(void *ctx, unit32 i, const struct ddp_entry *e, int kept);
+
+struct ddp_pack_params
+{
+	int level;
+	unit32 threads;//压缩线程数
+	unit32 budget;//已压缩未写出的条目最多占用的内存，0为默认的64MB
+	int incremental;//只重新压缩解包后改动过的文件，需要清单
+	int patch;//改动过的文件追加到原封包末尾，就地更新索引和清单，需要清单
+	ddp_pack_fn done;//可以为NULL
+	void *ctx;
+	struct ddp_stats *stats;//可以为NULL
+	volatile int *cancel;//可以为NULL，其他线程置为非0后不再读入新的条目，返回DDP_ERR_CANCELLED并删除写了一半的新封包
+	int dedup;//内容相同的条目共用同一块数据区，-patch时忽略
+	const unit32 *order;//可以为NULL，数据区存放的顺序，见ddp_write_params，-patch时忽略
+	unit32 kept;//输出：沿用原数据的条目数
+	unit32 missing;//输出：读不到文件的条目，没有时为DDP_NOT_FOUND
+	int has_manifest;//输出：解包目录中有与封包相符的清单
+	unit32 filesize;//输出：新封包的大小
+	unit32 saved;//输出：共用数据区省下的字节数
+};
+
+//把解包目录dir(为NULL时为<fname>_unpack)中的文件按ar的索引打包为outname，fname为ar的文件名
+//有清单时按清单中的类型找文件，否则只解压每个条目开头判断类型；patch时outname不使用，直接修改fname
+int ddp_pack_archive(ddp_archive *ar, const char *fname, const char *dir, const char *outname, struct ddp_pack_params *params);
+//ddp_compact_archive整理fname，解包目录dir(为NULL时为<fname>_unpack)中有清单时随之更新其中的封包大小
+int ddp_pack_compact(const char *fname, const char *dir, unit32 *saved);
+
+struct ddp_delta_stats
+{
+	unit32 same;//直接复制旧数据的条目数
+	unit32 changed;
+	unit32 added;
+	unit32 removed;
+	unit32 size;//补丁的大小
+};
+
+//比较两个格式相同的封包，把old变成new的补丁写到sink，DDP2按序号、DDP3按文件名对应条目
+//补丁只含新的索引表和新增、改动过的条目，stats可以为NULL
+int ddp_delta_create(const char *oldname, const char *newname, ddp_sink_fn sink, void *sink_ctx, struct ddp_delta_stats *stats);
+//顺序读取补丁，没改动的条目从旧封包按条目读取，写出新封包
+int ddp_delta_apply(const char *oldname, const char *patchname, const char *outname);
+
+//可重用的缓冲池，可以在多个线程中同时取用和归还(一个线程取出的缓冲可以由另一个线程归还)；缓冲按缓存行对齐，容量至少为创建时的size
+//空闲的缓冲按容量分组，取用和归还只在锁内做一次链表头的操作
+ddp_bufpool *ddp_bufpool_create(unit32 size);
+//取一个容量不小于len的缓冲，没有空闲的时才分配，失败返回NULL
+unit8 *ddp_bufpool_get(ddp_bufpool *p, unit32 len);
+//归还缓冲，buf可以为NULL
+void ddp_bufpool_put(ddp_bufpool *p, unit8 *buf);
+//释放池里的全部缓冲，取出的缓冲要先归还
+void ddp_bufpool_free(ddp_bufpool *p);
+
+unsigned long long ddp_hash64(const unit8 *data, unit32 len);
+//解包时写出的清单，记录每个条目的类型和解包出的文件的指纹
+//打包时据此找到文件而不用解压原条目，没改动过的条目直接复制原数据
+int ddp_manifest_write(const char *path, ddp_archive *ar, const struct ddp_manifest_entry *entries);
+//返回条目数个记录，清单不存在或与ar不符(条目数、封包大小不同)时返回NULL，需要free
+struct ddp_manifest_entry *ddp_manifest_read(const char *path, ddp_archive *ar);
+
+//布局：打包时条目数据在封包中存放的顺序，一起读取的条目放在一起，读取时接近顺序读
+enum
+{
+	DDP_LAYOUT_TYPE = 0,//同类型的条目放在一起，类型内按序号
+	DDP_LAYOUT_NAME//DDP3按文件名排序，同一目录的条目放在一起；DDP2没有文件名，按序号
+};
+
+//写出布局文件：第一行为"DDP layout <版本> <条目数>"，之后每行一个序号，可以只列出部分条目
+int ddp_layout_write(const char *path, ddp_archive *ar, const unit32 *order, unit32 num);
+//读取布局文件，没有列出的条目按序号接在后面，重复的序号只取第一次
+//返回条目数个序号的排列，需要free；文件不存在、格式错误或条目数与ar不同时返回NULL
+unit32 *ddp_layout_read(const char *path, ddp_archive *ar);
+//按mode生成排列，需要free
+unit32 *ddp_layout_guess(ddp_archive *ar, int mode);
+
+//--stats用的统计，阶段的耗时按条目记录，可以在多个线程中同时调用
+enum
+{
+	DDP_STAGE_READ = 0,//从封包读取存储的数据，映射时为缺页
+	DDP_STAGE_DECODE,//解压，HXB在同一遍中解密
+	DDP_STAGE_CREATE,//创建解包出的文件
+	DDP_STAGE_WRITE,//写入并关闭解包出的文件
+	DDP_STAGE_HASH,//计算清单中的哈希
+	DDP_STAGE_KEEP,//判断解包出的文件是否改动过
+	DDP_STAGE_LOAD,//读入解包出的文件，HXB同时加密
+	DDP_STAGE_COMPRESS,
+	DDP_STAGE_OUTPUT,//写入新封包
+	DDP_STAGE_COUNT
+};
+
+//entries为条目数，trace非0时同时记录每个事件，用于ddp_stats_write_trace
+ddp_stats *ddp_stats_create(unit32 entries, int trace);
+void ddp_stats_free(ddp_stats *s);
+//纳秒，s为NULL时返回0，关闭统计时几乎没有开销
+unsigned long long ddp_stats_now(ddp_stats *s);
+//记录第i个条目的stage阶段从start到现在的耗时，返回现在的时间，可以直接作为下一阶段的start
+unsigned long long ddp_stats_stage(ddp_stats *s, int stage, unit32 i, unsigned long long start);
+//记录一个处理完的条目：类型、读入和写出的字节数、在封包中是否未压缩
+void ddp_stats_entry(ddp_stats *s, int type, unit32 in, unit32 out, int stored);
+//输出各阶段的耗时、类型的分布和每个条目耗时的p50/p99
+void ddp_stats_print(ddp_stats *s, FILE *fp);
+//写出Chrome trace格式的JSON，可以用chrome://tracing或Perfetto打开
+int ddp_stats_write_trace(ddp_stats *s, const char *path);
+//按页读一遍第i个条目存储的数据，让缺页发生在这里而不是解压时，只在统计读取耗时时使用
+void ddp_touch_entry(ddp_archive *ar, unit32 i);
+
+const char *ddp_strerror(int err);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,603 @@
+#define _CRT_SECURE_NO_WARNINGS
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#ifdef _WIN32
+#include <Windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+#include "ddp_internal.h"
+
+static const char *type_ext[] = { "hxb", "bmp", "png", "tga", "bin" };
+
+static const char *error_str[] =
+{
+	"成功",
+	"无法打开文件",
+	"文件头不是DDP2或DDP3",
+	"索引表损坏",
+	"读取失败",
+	"写入失败",
+	"内存不足",
+	"压缩数据不完整",
+	"匹配偏移超出已解压的数据",
+	"解压结果超出原始大小",
+	"补丁损坏或与旧封包不符",
+	"已取消",
+	"文件名会写到解包目录以外",
+	"输出文件不能是正在读取的封包"
+};
+
+int ddp_sniff(const unit8 *data, unit32 len)
+{
+	if (len >= 7 && data[0] == 'D' && data[1] == 'D' && data[4] == 'H' && data[5] == 'X' && data[6] == 'B')//DDWuHXB，似乎还有种DDSxHXB
+		return DDP_TYPE_HXB;
+	if (len >= 2 && data[0] == 'B' && data[1] == 'M')
+		return DDP_TYPE_BMP;
+	if (len >= 4 && data[0] == 0x89 && data[1] == 0x50 && data[2] == 0x4E && data[3] == 0x47)
+		return DDP_TYPE_PNG;
+	if (len >= 3 && data[0] == 0 && data[1] == 0 && (data[2] == 0x0A || data[2] == 0x02))
+		return DDP_TYPE_TGA;
+	return DDP_TYPE_BIN;
+}
+
+const char *ddp_type_ext(int type)
+{
+	return type_ext[type];
+}
+
+const char *ddp_strerror(int err)
+{
+	return error_str[err];
+}
+
+static int ddp_pread(ddp_archive *ar, void *buf, unit32 len, unit32 offset)
+{
+#ifdef _WIN32
+	OVERLAPPED ov;
+	DWORD got;
+	memset(&ov, 0, sizeof(ov));
+	ov.Offset = offset;
+	return ReadFile(ar->file, buf, len, &got, &ov) && got == len;
+#else
+	return pread(ar->fd, buf, len, offset) == (ssize_t)len;
+#endif
+}
+
+static int ddp_map(ddp_archive *ar, const char *fname)
+{
+#ifdef _WIN32
+	ar->file = CreateFileA(fname, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (ar->file == INVALID_HANDLE_VALUE)
+		return 0;
+	ar->size = GetFileSize(ar->file, NULL);
+	ar->mapping = CreateFileMappingA(ar->file, NULL, PAGE_READONLY, 0, 0, NULL);
+	if (ar->mapping != NULL)
+		ar->map = MapViewOfFile(ar->mapping, FILE_MAP_READ, 0, 0, 0);
+#else
+	struct stat st;
+	void *p;
+	ar->fd = open(fname, O_RDONLY);
+	if (ar->fd < 0 || fstat(ar->fd, &st) != 0)
+		return 0;
+	ar->size = (unit32)st.st_size;
+	if (st.st_size == 0)
+		return 1;
+	p = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, ar->fd, 0);
+	if (p != MAP_FAILED)
+		ar->map = p;
+#endif
+	return 1;
+}
+
+static void ddp_unmap(ddp_archive *ar)
+{
+#ifdef _WIN32
+	if (ar->map != NULL)
+		UnmapViewOfFile(ar->map);
+	if (ar->mapping != NULL)
+		CloseHandle(ar->mapping);
+	if (ar->file != INVALID_HANDLE_VALUE)
+		CloseHandle(ar->file);
+#else
+	if (ar->map != NULL)
+		munmap(ar->map, ar->size);
+	if (ar->fd >= 0)
+		close(ar->fd);
+#endif
+	ar->map = NULL;
+}
+
+static int ddp_read(ddp_archive *ar, void *buf, unit32 len, unit32 offset)
+{
+	if (offset > ar->size || len > ar->size - offset)
+		return 0;
+	if (ar->map != NULL)
+	{
+		memcpy(buf, ar->map + offset, len);
+		return 1;
+	}
+	return ddp_pread(ar, buf, len, offset);
+}
+
+//按条目数分配索引数组，DDP2只需要3个，DDP3还要记录位置和pack块
+static int ddp_alloc_index(ddp_archive *ar)
+{
+	unit32 n = ar->format == DDP_FORMAT_DDP3 ? 5 : 3, count = ar->count ? ar->count : 1;
+	if ((unsigned long long)count * n * sizeof(unit32) > (size_t)-1)
+		return DDP_ERR_NOMEM;
+	ar->offset = malloc((size_t)count * n * sizeof(unit32));
+	if (ar->offset == NULL)
+		return DDP_ERR_NOMEM;
+	ar->uncomprlen = ar->offset + count;
+	ar->comprlen = ar->uncomprlen + count;
+	if (n == 5)
+	{
+		ar->record = ar->comprlen + count;
+		ar->pack = ar->record + count;
+	}
+	return DDP_OK;
+}
+
+static void ddp_read_record(ddp_archive *ar, unit32 i, unit32 pos)
+{
+	memcpy(&ar->offset[i], ar->head + pos, 4);
+	memcpy(&ar->uncomprlen[i], ar->head + pos + 4, 4);
+	memcpy(&ar->comprlen[i], ar->head + pos + 8, 4);
+}
+
+static unit32 ddp_record_pos(ddp_archive *ar, unit32 i)
+{
+	return ar->record != NULL ? ar->record[i] : 0x20 + i * 0x10;
+}
+
+//DDP2的索引从0x20开始，每条16字节
+static int ddp2_parse(ddp_archive *ar)
+{
+	unit32 i;
+	int err;
+	ar->count = ar->header.num;
+	if (0x20 + (unsigned long long)ar->count * 0x10 > ar->header.file_offset)
+		return DDP_ERR_FORMAT;
+	err = ddp_alloc_index(ar);
+	if (err != DDP_OK)
+		return err;
+	for (i = 0; i < ar->count; i++)
+		ddp_read_record(ar, i, 0x20 + i * 0x10);
+	return DDP_OK;
+}
+
+//DDP3在0x20处是pack块表，每个pack块里是变长的索引记录，fill为0时只计数
+static int ddp3_walk(ddp_archive *ar, int fill)
+{
+	unit32 i, k = 0, getsize, pos, pack_size, pack_offset, limit = ar->header.file_offset;
+	if (0x20 + (unsigned long long)ar->header.num * 8 > limit)
+		return DDP_ERR_FORMAT;
+	for (i = 0; i < ar->header.num; i++)
+	{
+		memcpy(&pack_size, ar->head + 0x20 + i * 8, 4);
+		memcpy(&pack_offset, ar->head + 0x20 + i * 8 + 4, 4);
+		if (pack_size == 0)
+			continue;
+		getsize = 0;
+		pos = pack_offset;
+		do
+		{
+			if (pos >= limit || ar->head[pos] < 0x11 || ar->head[pos] > limit - pos)
+				return DDP_ERR_FORMAT;
+			if (fill)
+			{
+				ar->record[k] = pos;
+				ar->pack[k] = i;
+				ddp_read_record(ar, k, pos + 1);
+			}
+			getsize += ar->head[pos];
+			pos += ar->head[pos];
+			k++;
+		} while (getsize < pack_size - 1);
+	}
+	ar->count = k;
+	return DDP_OK;
+}
+
+static int ddp3_parse(ddp_archive *ar)
+{
+	int err = ddp3_walk(ar, 0);
+	if (err != DDP_OK)
+		return err;
+	err = ddp_alloc_index(ar);
+	if (err != DDP_OK)
+		return err;
+	return ddp3_walk(ar, 1);
+}
+
+ddp_archive *ddp_open(const char *fname, int *err)
+{
+	ddp_archive *ar = calloc(1, sizeof(ddp_archive));
+	int ret = DDP_OK;
+	if (ar == NULL)
+	{
+		if (err != NULL)
+			*err = DDP_ERR_NOMEM;
+		return NULL;
+	}
+#ifdef _WIN32
+	ar->file = INVALID_HANDLE_VALUE;
+#else
+	ar->fd = -1;
+#endif
+	if (!ddp_map(ar, fname))
+		ret = DDP_ERR_OPEN;
+	else if (!ddp_read(ar, ar->header.magic, 12, 0) || !ddp_read(ar, &ar->header.filesize, 4, ar->size - 4))
+		ret = DDP_ERR_READ;
+	else if (strncmp((char *)ar->header.magic, "DDP2", 4) == 0)
+		ar->format = DDP_FORMAT_DDP2;
+	else if (strncmp((char *)ar->header.magic, "DDP3", 4) == 0)
+		ar->format = DDP_FORMAT_DDP3;
+	else
+		ret = DDP_ERR_MAGIC;
+	if (ret == DDP_OK && (ar->header.file_offset < 0x20 || ar->header.file_offset > ar->size))
+		ret = DDP_ERR_FORMAT;
+	if (ret == DDP_OK)
+	{
+		ar->head = malloc(ar->header.file_offset);
+		if (ar->head == NULL)
+			ret = DDP_ERR_NOMEM;
+		else if (!ddp_read(ar, ar->head, ar->header.file_offset, 0))
+			ret = DDP_ERR_READ;
+	}
+	if (ret == DDP_OK)
+		ret = ar->format == DDP_FORMAT_DDP2 ? ddp2_parse(ar) : ddp3_parse(ar);
+	if (ret != DDP_OK)
+	{
+		ddp_close(ar);
+		ar = NULL;
+	}
+	if (err != NULL)
+		*err = ret;
+	return ar;
+}
+
+void ddp_close(ddp_archive *ar)
+{
+	if (ar == NULL)
+		return;
+	ddp_unmap(ar);
+	free(ar->offset);
+	free(ar->names);
+	free((void *)ar->accessed);
+	free(ar->access);
+	free(ar->head);
+	free(ar);
+}
+
+int ddp_archive_format(ddp_archive *ar)
+{
+	return ar->format;
+}
+
+const struct ddp_header *ddp_archive_header(ddp_archive *ar)
+{
+	return &ar->header;
+}
+
+unit32 ddp_entry_count(ddp_archive *ar)
+{
+	return ar->count;
+}
+
+const struct ddp_entry *ddp_get_entry(ddp_archive *ar, unit32 i, struct ddp_entry *e)
+{
+	if (i >= ar->count)
+		return NULL;
+	e->offset = ar->offset[i];
+	e->uncomprlen = ar->uncomprlen[i];
+	e->comprlen = ar->comprlen[i];
+	e->record = ddp_record_pos(ar, i);
+	if (ar->format == DDP_FORMAT_DDP3)
+	{
+		e->pack = ar->pack[i];
+		e->len = ar->head[e->record];
+		e->name = ar->head + e->record + 0x11;
+		e->namelen = e->len - 0x11;
+	}
+	else
+	{
+		e->pack = 0;
+		e->len = 0;
+		e->name = NULL;
+		e->namelen = 0;
+	}
+	return e;
+}
+
+//去掉文件名结尾的0
+static unit32 ddp_name_len(const unit8 *name, unit32 len)
+{
+	len &= ~1u;
+	while (len >= 2 && name[len - 2] == 0 && name[len - 1] == 0)
+		len -= 2;
+	return len;
+}
+
+//散列表的大小为不小于条目数2倍的2的幂，线性探测
+static unit32 ddp_names_mask(ddp_archive *ar)
+{
+	unit32 size = 1;
+	while (size < ar->count * 2)
+		size <<= 1;
+	return size - 1;
+}
+
+static unit32 *ddp_build_names(ddp_archive *ar)
+{
+	unit32 *table, mask = ddp_names_mask(ar), i, k, pos;
+	table = malloc((mask + 1) * sizeof(unit32));
+	if (table == NULL)
+		return NULL;
+	memset(table, 0xFF, (mask + 1) * sizeof(unit32));
+	for (i = 0; i < ar->count; i++)
+	{
+		pos = ar->record[i];
+		k = (unit32)ddp_hash64(ar->head + pos + 0x11, ddp_name_len(ar->head + pos + 0x11, ar->head[pos] - 0x11)) & mask;
+		while (table[k] != DDP_NOT_FOUND)
+			k = (k + 1) & mask;
+		table[k] = i;
+	}
+	//多个线程同时第一次查找时只保留一份
+#ifdef _WIN32
+	if (InterlockedCompareExchangePointer((PVOID volatile *)&ar->names, table, NULL) != NULL)
+#else
+	if (!__sync_bool_compare_and_swap(&ar->names, NULL, table))
+#endif
+		free(table);
+	return ar->names;
+}
+
+unit32 ddp_find_entry(ddp_archive *ar, const unit8 *name, unit32 namelen)
+{
+	unit32 *table = ar->names, mask, k, pos, len;
+	if (ar->format != DDP_FORMAT_DDP3)
+		return DDP_NOT_FOUND;
+	if (table == NULL && (table = ddp_build_names(ar)) == NULL)
+		return DDP_NOT_FOUND;
+	mask = ddp_names_mask(ar);
+	namelen = ddp_name_len(name, namelen);
+	for (k = (unit32)ddp_hash64(name, namelen) & mask; table[k] != DDP_NOT_FOUND; k = (k + 1) & mask)
+	{
+		pos = ar->record[table[k]];
+		len = ddp_name_len(ar->head + pos + 0x11, ar->head[pos] - 0x11);
+		if (len == namelen && memcmp(ar->head + pos + 0x11, name, len) == 0)
+			return table[k];
+	}
+	return DDP_NOT_FOUND;
+}
+
+void ddp_iter_begin(struct ddp_iter *it, ddp_archive *ar)
+{
+	it->ar = ar;
+	it->next = 0;
+}
+
+const struct ddp_entry *ddp_iter_next(struct ddp_iter *it)
+{
+	return ddp_get_entry(it->ar, it->next++, &it->entry);
+}
+
+int ddp_record_access(ddp_archive *ar)
+{
+	if (ar->accessed != NULL)
+		return DDP_OK;
+	ar->access = malloc((ar->count ? ar->count : 1) * sizeof(unit32));
+	ar->accessed = calloc(ar->count ? ar->count : 1, 1);
+	if (ar->access == NULL || ar->accessed == NULL)
+	{
+		free(ar->access);
+		free((void *)ar->accessed);
+		ar->access = NULL;
+		ar->accessed = NULL;
+		return DDP_ERR_NOMEM;
+	}
+	ar->naccess = 0;
+	return DDP_OK;
+}
+
+unit32 ddp_recorded_access(ddp_archive *ar, const unit32 **order)
+{
+	*order = ar->access;
+	return ar->accessed != NULL ? ar->naccess : 0;
+}
+
+//每个条目第一次被读取时记下顺序，多个线程同时读取同一个条目时也只记一次
+static void ddp_note_access(ddp_archive *ar, unit32 i)
+{
+	if (ar->accessed != NULL && i < ar->count && ar->accessed[i] == 0 && ddp_atomic_set8(&ar->accessed[i]) == 0)
+		ar->access[ddp_atomic_inc32(&ar->naccess)] = i;
+}
+
+//decrypt为1时HXB条目在解压(或从映射复制)的同时解密
+static unit8 *ddp_load(ddp_archive *ar, unit32 i, unit8 **owned, int decrypt)
+{
+	unit32 offset = ar->offset[i], uncomprlen = ar->uncomprlen[i], comprlen = ar->comprlen[i];
+	unit8 *cdata, *udata, *buf = NULL;
+	unit32 len = comprlen != 0 ? comprlen : uncomprlen, key, n;
+	*owned = NULL;
+	ddp_note_access(ar, i);
+	if (offset > ar->size || len > ar->size - offset)
+		return NULL;
+	if (ar->map != NULL)
+		cdata = ar->map + offset;
+	else
+	{
+		cdata = buf = malloc(len ? len : 1);
+		if (buf == NULL || !ddp_pread(ar, buf, len, offset))
+		{
+			free(buf);
+			return NULL;
+		}
+	}
+	if (comprlen == 0)
+	{
+		udata = cdata;
+		if (decrypt && len >= 0x10 && ddp_sniff(cdata, len) == DDP_TYPE_HXB)
+		{
+			key = ddp_hxb_key((const struct ddp_hxb_header *)cdata, len, &n);
+			if (buf == NULL)//映射的内存只读，复制的同时解密
+			{
+				udata = buf = malloc(len);
+				if (buf == NULL)
+					return NULL;
+				memcpy(buf, cdata, 0x10);
+				memcpy(buf + 0x10 + n, cdata + 0x10 + n, len - 0x10 - n);
+			}
+			ddp_hxb_xor(udata + 0x10, cdata + 0x10, n, key);
+		}
+	}
+	else
+	{
+		udata = malloc(uncomprlen ? uncomprlen : 1);
+		if (udata != NULL && (decrypt ? ddp_uncompress_hxb(udata, uncomprlen, cdata, comprlen)
+			: ddp_uncompress_safe(udata, uncomprlen, cdata, comprlen)) != DDP_OK)
+		{
+			free(udata);
+			udata = NULL;
+		}
+		free(buf);
+		buf = udata;
+	}
+	*owned = buf;
+	return udata;
+}
+
+unit8 *ddp_load_entry(ddp_archive *ar, unit32 i, unit8 **owned)
+{
+	return ddp_load(ar, i, owned, 0);
+}
+
+unit8 *ddp_load_decrypted(ddp_archive *ar, unit32 i, unit8 **owned)
+{
+	return ddp_load(ar, i, owned, 1);
+}
+
+//没有映射时压缩的数据读到buf中解压结果的后面
+unit8 *ddp_load_into(ddp_archive *ar, unit32 i, unit8 *buf, unit32 buflen)
+{
+	unit32 offset = ar->offset[i], uncomprlen = ar->uncomprlen[i], comprlen = ar->comprlen[i];
+	unit32 len = comprlen != 0 ? comprlen : uncomprlen, key, n;
+	unit8 *cdata;
+	ddp_note_access(ar, i);
+	if (offset > ar->size || len > ar->size - offset || (unsigned long long)uncomprlen + comprlen > buflen)
+		return NULL;
+	if (ar->map != NULL)
+		cdata = ar->map + offset;
+	else
+	{
+		cdata = comprlen != 0 ? buf + uncomprlen : buf;
+		if (!ddp_pread(ar, cdata, len, offset))
+			return NULL;
+	}
+	if (comprlen != 0)
+		return ddp_uncompress_hxb(buf, uncomprlen, cdata, comprlen) == DDP_OK ? buf : NULL;
+	if (len < 0x10 || ddp_sniff(cdata, len) != DDP_TYPE_HXB)
+		return cdata;
+	key = ddp_hxb_key((const struct ddp_hxb_header *)cdata, len, &n);
+	if (cdata != buf)//映射的内存只读，复制的同时解密
+	{
+		memcpy(buf, cdata, 0x10);
+		memcpy(buf + 0x10 + n, cdata + 0x10 + n, len - 0x10 - n);
+	}
+	ddp_hxb_xor(buf + 0x10, cdata + 0x10, n, key);
+	return buf;
+}
+
+void ddp_max_lengths(ddp_archive *ar, unit32 *uncomprlen, unit32 *comprlen)
+{
+	unit32 i, maxu = 0, maxc = 0;
+	for (i = 0; i < ar->count; i++)
+	{
+		if (ar->uncomprlen[i] > maxu)
+			maxu = ar->uncomprlen[i];
+		if (ar->comprlen[i] > maxc)
+			maxc = ar->comprlen[i];
+	}
+	*uncomprlen = maxu;
+	*comprlen = maxc;
+}
+
+int ddp_read_entry(ddp_archive *ar, unit32 i, unit8 *buf, unit32 buflen)
+{
+	unit32 offset = ar->offset[i], uncomprlen = ar->uncomprlen[i], comprlen = ar->comprlen[i];
+	unit8 *cdata;
+	int ret = DDP_OK;
+	ddp_note_access(ar, i);
+	if (buflen < uncomprlen)
+		return DDP_ERR_NOMEM;
+	if (comprlen == 0)
+		return ddp_read(ar, buf, uncomprlen, offset) ? DDP_OK : DDP_ERR_READ;
+	if (offset > ar->size || comprlen > ar->size - offset)
+		return DDP_ERR_READ;
+	if (ar->map != NULL)
+		return ddp_uncompress_safe(buf, uncomprlen, ar->map + offset, comprlen);
+	cdata = malloc(comprlen);
+	if (cdata == NULL)
+		return DDP_ERR_NOMEM;
+	if (ddp_pread(ar, cdata, comprlen, offset))
+		ret = ddp_uncompress_safe(buf, uncomprlen, cdata, comprlen);
+	else
+		ret = DDP_ERR_READ;
+	free(cdata);
+	return ret;
+}
+
+int ddp_read_raw(ddp_archive *ar, unit32 i, unit8 *buf, unit32 buflen)
+{
+	unit32 offset = ar->offset[i], uncomprlen = ar->uncomprlen[i], comprlen = ar->comprlen[i];
+	unit32 len = comprlen != 0 ? comprlen : uncomprlen;
+	ddp_note_access(ar, i);
+	if (buflen < len)
+		return DDP_ERR_NOMEM;
+	return ddp_read(ar, buf, len, offset) ? DDP_OK : DDP_ERR_READ;
+}
+
+//没有映射时读取发生在解压之前的ddp_read里，这里什么都不做
+void ddp_touch_entry(ddp_archive *ar, unit32 i)
+{
+	unit32 offset, len, k;
+	volatile unit8 sum = 0;
+	if (i >= ar->count || ar->map == NULL)
+		return;
+	offset = ar->offset[i];
+	len = ar->comprlen[i] != 0 ? ar->comprlen[i] : ar->uncomprlen[i];
+	if (offset > ar->size || len > ar->size - offset)
+		return;
+	for (k = 0; k < len; k += 4096)
+		sum += ar->map[offset + k];
+	if (len != 0)
+		sum += ar->map[offset + len - 1];
+}
+
+int ddp_entry_type(ddp_archive *ar, unit32 i)
+{
+	unit32 offset = ar->offset[i], uncomprlen = ar->uncomprlen[i], comprlen = ar->comprlen[i];
+	unit8 head[DDP_SNIFF_LEN], raw[DDP_SNIFF_LEN * 8];
+	unit32 len;
+	if (comprlen == 0)
+	{
+		len = uncomprlen < DDP_SNIFF_LEN ? uncomprlen : DDP_SNIFF_LEN;
+		if (!ddp_read(ar, head, len, offset))
+			return DDP_TYPE_BIN;
+	}
+	else
+	{
+		//每个token至少输出1字节、token头最长7字节，所以DDP_SNIFF_LEN字节的输出最多需要8倍的输入
+		len = comprlen < sizeof(raw) ? comprlen : sizeof(raw);
+		if (!ddp_read(ar, raw, len, offset))
+			return DDP_TYPE_BIN;
+		len = ddp_uncompress_partial(head, uncomprlen < DDP_SNIFF_LEN ? uncomprlen : DDP_SNIFF_LEN, raw, len);
+	}
+	return ddp_sniff(head, len);
+}
@@ -0,0 +1,123 @@
+#include <stdlib.h>
+#ifdef _WIN32
+#include <malloc.h>
+#endif
+#include "ddp_internal.h"
+
+#define DDP_CACHE_LINE 64
+
+#define DDP_BUFPOOL_CLASSES 33//按容量的最高位分组，容量在[2^k, 2^(k+1))的空闲缓冲放在第k组
+
+//每个缓冲前面有一个缓存行大小的头，容量按缓存行取整，不同线程拿到的缓冲不会共用缓存行
+struct ddp_buffer_head
+{
+	struct ddp_buffer_head *next;//空闲链表
+	unit32 size;
+};
+
+//整个封包共用一个池而不是每个线程一对缓冲：压缩线程取出的缓冲要等调用线程按顺序写出后才归还，
+//一个线程在内存预算内可以同时占着多个条目的缓冲，取用和归还常在不同的线程中。
+//锁内只在链表头取放，取用时从能放下len的最小一组开始找，小条目不会拿走大缓冲
+struct ddp_bufpool
+{
+	ddp_mutex lock;
+	unit32 size;//新分配的缓冲的最小容量
+	struct ddp_buffer_head *free[DDP_BUFPOOL_CLASSES];
+};
+
+static unit32 ddp_bufpool_class(unit32 size)
+{
+	unit32 k = 0;
+	while (size >>= 1)
+		k++;
+	return k;
+}
+
+void *ddp_alloc_aligned(size_t size, unit32 align)
+{
+#ifdef _WIN32
+	return _aligned_malloc(size, align);
+#else
+	void *p;
+	return posix_memalign(&p, align, size) == 0 ? p : NULL;
+#endif
+}
+
+void ddp_free_aligned(void *p)
+{
+#ifdef _WIN32
+	_aligned_free(p);
+#else
+	free(p);
+#endif
+}
+
+ddp_bufpool *ddp_bufpool_create(unit32 size)
+{
+	ddp_bufpool *p = calloc(1, sizeof(ddp_bufpool));
+	if (p == NULL)
+		return NULL;
+	ddp_mutex_init(&p->lock);
+	p->size = size;
+	return p;
+}
+
+void ddp_bufpool_free(ddp_bufpool *p)
+{
+	struct ddp_buffer_head *h;
+	unit32 k;
+	if (p == NULL)
+		return;
+	for (k = 0; k < DDP_BUFPOOL_CLASSES; k++)
+		while ((h = p->free[k]) != NULL)
+		{
+			p->free[k] = h->next;
+			ddp_free_aligned(h);
+		}
+	ddp_mutex_destroy(&p->lock);
+	free(p);
+}
+
+unit8 *ddp_bufpool_get(ddp_bufpool *p, unit32 len)
+{
+	struct ddp_buffer_head *h = NULL;
+	unsigned long long size;
+	unit32 k = ddp_bufpool_class(len);
+	ddp_mutex_lock(&p->lock);
+	//len所在的一组中容量可能不够，只看链表头；更高的组一定放得下
+	if (p->free[k] != NULL && p->free[k]->size >= len)
+		h = p->free[k];
+	for (k++; h == NULL && k < DDP_BUFPOOL_CLASSES; k++)
+		h = p->free[k];
+	if (h != NULL)
+		p->free[ddp_bufpool_class(h->size)] = h->next;
+	ddp_mutex_unlock(&p->lock);
+	if (h == NULL)
+	{
+		//比预计大的内容单独分配，归还后同样留在池里
+		size = ((unsigned long long)(len > p->size ? len : p->size) + DDP_CACHE_LINE - 1) & ~(unsigned long long)(DDP_CACHE_LINE - 1);
+		if (size == 0)
+			size = DDP_CACHE_LINE;
+		if (size > 0xFFFFFFFF || (size_t)size != size)
+			return NULL;
+		h = ddp_alloc_aligned((size_t)size + DDP_CACHE_LINE, DDP_CACHE_LINE);
+		if (h == NULL)
+			return NULL;
+		h->size = (unit32)size;
+	}
+	return (unit8 *)h + DDP_CACHE_LINE;
+}
+
+void ddp_bufpool_put(ddp_bufpool *p, unit8 *buf)
+{
+	struct ddp_buffer_head *h;
+	unit32 k;
+	if (buf == NULL)
+		return;
+	h = (struct ddp_buffer_head *)(buf - DDP_CACHE_LINE);
+	k = ddp_bufpool_class(h->size);
+	ddp_mutex_lock(&p->lock);
+	h->next = p->free[k];
+	p->free[k] = h;
+	ddp_mutex_unlock(&p->lock);
+}
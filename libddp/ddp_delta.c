@@ -0,0 +1,401 @@
+#define _CRT_SECURE_NO_WARNINGS
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "ddp_internal.h"
+
+/*
+补丁由文件头、新封包的索引表和一串操作组成，操作按新封包中数据的偏移排列，应用时顺序写出即可
+每个操作以1字节开头，后面的参数都是unit32：
+'C' 旧序号 条数：连续的条目直接复制旧封包中存储的数据
+'D' 长度 数据：一个条目存储的原始数据
+'Z' 长度 压缩后长度 数据：同上，原始数据在封包中未压缩，补丁里用DDP压缩过
+'S' 长度：新封包中没被条目引用的空隙，写出0
+'E' 文件大小：结束，写出最后4字节
+*/
+#define DDP_DELTA_VERSION 1
+
+struct ddp_delta_header
+{
+	unit8 magic[4];//DDPD
+	unit32 version;
+	unit32 format;
+	unit32 oldsize;//旧封包的大小和索引表的哈希，应用前用来确认旧封包
+	unsigned long long oldhash;
+	unit32 headlen;//新索引表[0, file_offset)的长度
+	unit32 packedlen;//新索引表压缩后的长度，0为未压缩
+};
+
+struct ddp_delta_out
+{
+	ddp_sink_fn sink;
+	void *ctx;
+	unit32 size;
+	int err;
+};
+
+struct ddp_delta_pos
+{
+	unit32 offset;
+	unit32 i;
+};
+
+static void ddp_delta_put(struct ddp_delta_out *o, const void *data, unit32 len)
+{
+	if (o->err == DDP_OK && len != 0 && !o->sink(o->ctx, data, len))
+		o->err = DDP_ERR_WRITE;
+	o->size += len;
+}
+
+static void ddp_delta_op(struct ddp_delta_out *o, unit8 op, unit32 a, unit32 b, int args)
+{
+	ddp_delta_put(o, &op, 1);
+	if (args > 0)
+		ddp_delta_put(o, &a, 4);
+	if (args > 1)
+		ddp_delta_put(o, &b, 4);
+}
+
+//条目存储的原始数据，映射时直接指向映射的内存，否则读到*buf
+static const unit8 *ddp_delta_raw(ddp_archive *ar, unit32 i, unit8 **buf, unit32 *len)
+{
+	*len = ar->comprlen[i] != 0 ? ar->comprlen[i] : ar->uncomprlen[i];
+	*buf = NULL;
+	if (ar->offset[i] > ar->size || *len > ar->size - ar->offset[i])
+		return NULL;
+	if (ar->map != NULL)
+		return ar->map + ar->offset[i];
+	*buf = malloc(*len ? *len : 1);
+	if (*buf != NULL && ddp_read_raw(ar, i, *buf, *len) == DDP_OK)
+		return *buf;
+	free(*buf);
+	*buf = NULL;
+	return NULL;
+}
+
+//把*buf扩大到至少need字节，失败返回0
+static int ddp_delta_grow(unit8 **buf, unit32 *cap, unit32 need)
+{
+	unit8 *p;
+	if (need <= *cap)
+		return 1;
+	p = realloc(*buf, need);
+	if (p == NULL)
+		return 0;
+	*buf = p;
+	*cap = need;
+	return 1;
+}
+
+static int ddp_delta_cmp(const void *a, const void *b)
+{
+	const struct ddp_delta_pos *x = a, *y = b;
+	if (x->offset != y->offset)
+		return x->offset < y->offset ? -1 : 1;
+	return x->i < y->i ? -1 : x->i > y->i;
+}
+
+//match[i]为新封包第i个条目在旧封包中的序号，没有时为DDP_NOT_FOUND
+static unit32 *ddp_delta_match(ddp_archive *old, ddp_archive *new)
+{
+	struct ddp_entry e;
+	unit32 *match, i;
+	match = malloc((new->count ? new->count : 1) * sizeof(unit32));
+	if (match == NULL)
+		return NULL;
+	for (i = 0; i < new->count; i++)
+	{
+		if (old->format == DDP_FORMAT_DDP2)
+			match[i] = i < old->count ? i : DDP_NOT_FOUND;
+		else
+		{
+			ddp_get_entry(new, i, &e);
+			match[i] = ddp_find_entry(old, e.name, e.namelen);
+		}
+	}
+	return match;
+}
+
+static int ddp_delta_write(ddp_archive *old, ddp_archive *new, const unit32 *match, struct ddp_delta_out *o, struct ddp_delta_stats *stats)
+{
+	struct ddp_delta_header h;
+	struct ddp_delta_pos *order;
+	unit8 *seen, *packed, *obuf, *nbuf, *tmp = NULL;
+	const unit8 *odata, *ndata;
+	unit32 i, j, k, olen, nlen, plen, pos, last, lastlen = 0, run = 0, runlen = 0, tmpcap = 0;
+	int same;
+	order = malloc((new->count ? new->count : 1) * sizeof(struct ddp_delta_pos));
+	seen = calloc(old->count ? old->count : 1, 1);
+	packed = malloc(new->header.file_offset);
+	if (order == NULL || seen == NULL || packed == NULL)
+	{
+		free(order);
+		free(seen);
+		free(packed);
+		return DDP_ERR_NOMEM;
+	}
+	memcpy(h.magic, "DDPD", 4);
+	h.version = DDP_DELTA_VERSION;
+	h.format = old->format;
+	h.oldsize = old->size;
+	h.oldhash = ddp_hash64(old->head, old->header.file_offset);
+	h.headlen = new->header.file_offset;
+	h.packedlen = ddp_compress(packed, h.headlen, new->head, h.headlen, DDP_LEVEL_OPTIMAL);
+	ddp_delta_put(o, &h, sizeof(h));
+	ddp_delta_put(o, h.packedlen != 0 ? packed : new->head, h.packedlen != 0 ? h.packedlen : h.headlen);
+	for (i = 0; i < new->count; i++)
+	{
+		order[i].offset = new->offset[i];
+		order[i].i = i;
+	}
+	qsort(order, new->count, sizeof(struct ddp_delta_pos), ddp_delta_cmp);
+	pos = last = new->header.file_offset;
+	for (k = 0; k < new->count && o->err == DDP_OK; k++)
+	{
+		i = order[k].i;
+		j = match[i];
+		if (j != DDP_NOT_FOUND)
+			seen[j] = 1;
+		nlen = new->comprlen[i] != 0 ? new->comprlen[i] : new->uncomprlen[i];
+		if (new->offset[i] < pos)
+		{
+			//与上一个写出的数据区完全相同时是共用数据(偏移相同的条目排在一起)，只重叠一部分时补丁无法表示
+			if (nlen != 0 && (new->offset[i] != last || nlen != lastlen))
+			{
+				o->err = DDP_ERR_FORMAT;
+				break;
+			}
+			stats->same++;
+			continue;
+		}
+		if (new->offset[i] > pos)
+		{
+			if (runlen != 0)
+				ddp_delta_op(o, 'C', run, runlen, 2);
+			runlen = 0;
+			ddp_delta_op(o, 'S', new->offset[i] - pos, 0, 1);
+			pos = new->offset[i];
+		}
+		ndata = ddp_delta_raw(new, i, &nbuf, &nlen);
+		if (ndata == NULL)
+		{
+			o->err = DDP_ERR_READ;
+			break;
+		}
+		same = 0;
+		if (j != DDP_NOT_FOUND && old->comprlen[j] == new->comprlen[i] && old->uncomprlen[j] == new->uncomprlen[i])
+		{
+			odata = ddp_delta_raw(old, j, &obuf, &olen);
+			same = odata != NULL && memcmp(odata, ndata, nlen) == 0;
+			free(obuf);
+		}
+		last = pos;
+		lastlen = nlen;
+		pos += nlen;
+		if (same)
+		{
+			stats->same++;
+			if (runlen != 0 && run + runlen == j)
+				runlen++;
+			else
+			{
+				if (runlen != 0)
+					ddp_delta_op(o, 'C', run, runlen, 2);
+				run = j;
+				runlen = 1;
+			}
+			free(nbuf);
+			continue;
+		}
+		if (runlen != 0)
+			ddp_delta_op(o, 'C', run, runlen, 2);
+		runlen = 0;
+		if (j == DDP_NOT_FOUND)
+			stats->added++;
+		else
+			stats->changed++;
+		plen = 0;
+		if (new->comprlen[i] == 0 && nlen >= 0x10 && ddp_delta_grow(&tmp, &tmpcap, nlen))
+			plen = ddp_compress(tmp, nlen, (unit8 *)ndata, nlen, DDP_LEVEL_OPTIMAL);
+		if (plen != 0 && plen < nlen)
+		{
+			ddp_delta_op(o, 'Z', nlen, plen, 2);
+			ddp_delta_put(o, tmp, plen);
+		}
+		else
+		{
+			ddp_delta_op(o, 'D', nlen, 0, 1);
+			ddp_delta_put(o, ndata, nlen);
+		}
+		free(nbuf);
+	}
+	if (runlen != 0)
+		ddp_delta_op(o, 'C', run, runlen, 2);
+	if (new->size - 4 > pos)
+		ddp_delta_op(o, 'S', new->size - 4 - pos, 0, 1);
+	ddp_delta_op(o, 'E', new->header.filesize, 0, 1);
+	for (j = 0; j < old->count; j++)
+		stats->removed += !seen[j];
+	stats->size = o->size;
+	free(order);
+	free(seen);
+	free(packed);
+	free(tmp);
+	return o->err;
+}
+
+int ddp_delta_create(const char *oldname, const char *newname, ddp_sink_fn sink, void *sink_ctx, struct ddp_delta_stats *stats)
+{
+	ddp_archive *old, *new;
+	struct ddp_delta_out o;
+	struct ddp_delta_stats dummy;
+	unit32 *match;
+	int ret;
+	old = ddp_open(oldname, &ret);
+	if (old == NULL)
+		return ret;
+	new = ddp_open(newname, &ret);
+	if (new == NULL)
+	{
+		ddp_close(old);
+		return ret;
+	}
+	if (stats == NULL)
+		stats = &dummy;
+	memset(stats, 0, sizeof(*stats));
+	o.sink = sink;
+	o.ctx = sink_ctx;
+	o.size = 0;
+	o.err = DDP_OK;
+	if (old->format != new->format)
+		ret = DDP_ERR_MAGIC;
+	else if ((match = ddp_delta_match(old, new)) == NULL)
+		ret = DDP_ERR_NOMEM;
+	else
+	{
+		ret = ddp_delta_write(old, new, match, &o, stats);
+		free(match);
+	}
+	ddp_close(new);
+	ddp_close(old);
+	return ret;
+}
+
+static int ddp_delta_read(FILE *fp, void *data, unit32 len)
+{
+	return len == 0 || fread(data, len, 1, fp) == 1;
+}
+
+int ddp_delta_apply(const char *oldname, const char *patchname, const char *outname)
+{
+	ddp_archive *old;
+	FILE *fp, *out;
+	struct ddp_delta_header h;
+	unit8 op, *buf = NULL, *data = NULL, *raw;
+	const unit8 *src;
+	unit32 a, b, k, len, bufcap = 0, datacap = 0;
+	int ret = DDP_OK;
+	old = ddp_open(oldname, &ret);
+	if (old == NULL)
+		return ret;
+	fp = fopen(patchname, "rb");
+	if (fp == NULL)
+	{
+		ddp_close(old);
+		return DDP_ERR_OPEN;
+	}
+	out = fopen(outname, "wb");
+	if (out == NULL)
+	{
+		fclose(fp);
+		ddp_close(old);
+		return DDP_ERR_OPEN;
+	}
+	setvbuf(out, NULL, _IOFBF, 1 << 20);
+	if (!ddp_delta_read(fp, &h, sizeof(h)) || memcmp(h.magic, "DDPD", 4) != 0 || h.version != DDP_DELTA_VERSION
+		|| h.format != (unit32)old->format || h.oldsize != old->size || h.oldhash != ddp_hash64(old->head, old->header.file_offset))
+		ret = DDP_ERR_PATCH;
+	//新的索引表
+	else if (!ddp_delta_grow(&buf, &bufcap, h.headlen) || !ddp_delta_grow(&data, &datacap, h.packedlen))
+		ret = DDP_ERR_NOMEM;
+	else if (!ddp_delta_read(fp, h.packedlen != 0 ? data : buf, h.packedlen != 0 ? h.packedlen : h.headlen))
+		ret = DDP_ERR_PATCH;
+	else if (h.packedlen != 0 && ddp_uncompress_safe(buf, h.headlen, data, h.packedlen) != DDP_OK)
+		ret = DDP_ERR_PATCH;
+	else if (fwrite(buf, h.headlen, 1, out) != 1 && h.headlen != 0)
+		ret = DDP_ERR_WRITE;
+	while (ret == DDP_OK)
+	{
+		if (!ddp_delta_read(fp, &op, 1) || !ddp_delta_read(fp, &a, 4))
+		{
+			ret = DDP_ERR_PATCH;
+			break;
+		}
+		if (op == 'E')
+		{
+			if (fwrite(&a, 4, 1, out) != 1)
+				ret = DDP_ERR_WRITE;
+			break;
+		}
+		switch (op)
+		{
+		case 'C':
+			if (!ddp_delta_read(fp, &b, 4) || a > old->count || b > old->count - a)
+			{
+				ret = DDP_ERR_PATCH;
+				break;
+			}
+			for (k = a; k < a + b && ret == DDP_OK; k++)
+			{
+				src = ddp_delta_raw(old, k, &raw, &len);
+				if (src == NULL)
+					ret = DDP_ERR_READ;
+				else if (len != 0 && fwrite(src, len, 1, out) != 1)
+					ret = DDP_ERR_WRITE;
+				free(raw);
+			}
+			break;
+		case 'D':
+			if (!ddp_delta_grow(&buf, &bufcap, a))
+				ret = DDP_ERR_NOMEM;
+			else if (!ddp_delta_read(fp, buf, a))
+				ret = DDP_ERR_PATCH;
+			else if (a != 0 && fwrite(buf, a, 1, out) != 1)
+				ret = DDP_ERR_WRITE;
+			break;
+		case 'Z':
+			if (!ddp_delta_read(fp, &b, 4))
+				ret = DDP_ERR_PATCH;
+			else if (!ddp_delta_grow(&buf, &bufcap, a) || !ddp_delta_grow(&data, &datacap, b))
+				ret = DDP_ERR_NOMEM;
+			else if (!ddp_delta_read(fp, data, b) || ddp_uncompress_safe(buf, a, data, b) != DDP_OK)
+				ret = DDP_ERR_PATCH;
+			else if (fwrite(buf, a, 1, out) != 1)
+				ret = DDP_ERR_WRITE;
+			break;
+		case 'S':
+			if (!ddp_delta_grow(&buf, &bufcap, a < 0x10000 ? a : 0x10000))
+				ret = DDP_ERR_NOMEM;
+			else
+				memset(buf, 0, a < 0x10000 ? a : 0x10000);
+			for (; a != 0 && ret == DDP_OK; a -= len)
+			{
+				len = a < 0x10000 ? a : 0x10000;
+				if (fwrite(buf, len, 1, out) != 1)
+					ret = DDP_ERR_WRITE;
+			}
+			break;
+		default:
+			ret = DDP_ERR_PATCH;
+		}
+	}
+	free(buf);
+	free(data);
+	fclose(fp);
+	if (fclose(out) != 0 && ret == DDP_OK)
+		ret = DDP_ERR_WRITE;
+	if (ret != DDP_OK)
+		remove(outname);
+	ddp_close(old);
+	return ret;
+}
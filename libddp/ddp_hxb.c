@@ -0,0 +1,43 @@
+#include <string.h>
+#include "ddp_internal.h"
+
+unit32 ddp_hxb_key(const struct ddp_hxb_header *header, unit32 datalen, unit32 *len)
+{
+	unit32 seed = header->length[0] << 16 | header->length[1] << 8 | header->length[2];
+	unit32 words = seed > 13 ? (seed - 13) / 4 : 0;
+	unit32 avail = datalen > 0x10 ? (datalen - 0x10) / 4 : 0;
+	*len = (words < avail ? words : avail) * 4;
+	return (((seed << 5) ^ 0xA5) * (seed + 0x6F349)) ^ 0x34A9B129;
+}
+
+//数据从文件头后的0x10开始，不保证对齐，全部用非对齐的读写
+void ddp_hxb_xor(unit8 *dst, const unit8 *src, unit32 len, unit32 key)
+{
+	unit32 w;
+#if defined(DDP_AVX2)
+	__m256i k = _mm256_set1_epi32((int)key);
+	for (; len >= 32; len -= 32, src += 32, dst += 32)
+		_mm256_storeu_si256((__m256i *)dst, _mm256_xor_si256(_mm256_loadu_si256((const __m256i *)src), k));
+#elif defined(DDP_SSE2)
+	__m128i k = _mm_set1_epi32((int)key);
+	for (; len >= 16; len -= 16, src += 16, dst += 16)
+		_mm_storeu_si128((__m128i *)dst, _mm_xor_si128(_mm_loadu_si128((const __m128i *)src), k));
+#endif
+	for (; len >= 4; len -= 4, src += 4, dst += 4)
+	{
+		memcpy(&w, src, 4);
+		w ^= key;
+		memcpy(dst, &w, 4);
+	}
+}
+
+void ddp_hxb_decrypt(const struct ddp_hxb_header *header, unit8 *data, unit32 len)
+{
+	unit32 key = ddp_hxb_key(header, len, &len);
+	ddp_hxb_xor(data + 0x10, data + 0x10, len, key);
+}
+
+void ddp_hxb_encrypt(const struct ddp_hxb_header *header, unit8 *data, unit32 len)
+{
+	ddp_hxb_decrypt(header, data, len);
+}
@@ -0,0 +1,134 @@
+/*
+libddp内部共用的定义，不对外公开
+*/
+#ifndef DDP_INTERNAL_H
+#define DDP_INTERNAL_H
+
+#ifdef _WIN32
+#include <Windows.h>
+#endif
+#include "ddp.h"
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define DDP_AVX2
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define DDP_SSE2
+#endif
+
+#define DDP_WINDOW 0x2000//匹配偏移13位，窗口8KB
+
+//库内部用的线程和锁，Windows用CRITICAL_SECTION和条件变量，其他平台用pthread
+#ifdef _WIN32
+typedef CRITICAL_SECTION ddp_mutex;
+typedef CONDITION_VARIABLE ddp_cond;
+typedef HANDLE ddp_thread;
+typedef unsigned (__stdcall *ddp_thread_fn)(void *arg);
+#define DDP_THREAD_FN unsigned __stdcall
+#define ddp_mutex_init(m)     InitializeCriticalSection(m)
+#define ddp_mutex_destroy(m)  DeleteCriticalSection(m)
+#define ddp_mutex_lock(m)     EnterCriticalSection(m)
+#define ddp_mutex_unlock(m)   LeaveCriticalSection(m)
+#define ddp_cond_init(c)      InitializeConditionVariable(c)
+#define ddp_cond_destroy(c)   ((void)0)
+#define ddp_cond_wait(c, m)   SleepConditionVariableCS(c, m, INFINITE)
+#define ddp_cond_broadcast(c) WakeAllConditionVariable(c)
+#else
+#include <pthread.h>
+typedef pthread_mutex_t ddp_mutex;
+typedef pthread_cond_t ddp_cond;
+typedef pthread_t ddp_thread;
+typedef void *(*ddp_thread_fn)(void *arg);
+#define DDP_THREAD_FN void *
+#define ddp_mutex_init(m)     pthread_mutex_init(m, NULL)
+#define ddp_mutex_destroy(m)  pthread_mutex_destroy(m)
+#define ddp_mutex_lock(m)     pthread_mutex_lock(m)
+#define ddp_mutex_unlock(m)   pthread_mutex_unlock(m)
+#define ddp_cond_init(c)      pthread_cond_init(c, NULL)
+#define ddp_cond_destroy(c)   pthread_cond_destroy(c)
+#define ddp_cond_wait(c, m)   pthread_cond_wait(c, m)
+#define ddp_cond_broadcast(c) pthread_cond_broadcast(c)
+#endif
+
+//失败返回0
+int ddp_thread_start(ddp_thread *t, ddp_thread_fn fn, void *arg);
+void ddp_thread_join(ddp_thread t);
+//当前线程的编号，只用于trace中区分线程
+unit32 ddp_thread_id(void);
+//按align对齐分配，用ddp_free_aligned释放
+void *ddp_alloc_aligned(size_t size, unit32 align);
+void ddp_free_aligned(void *p);
+
+//都返回原来的值
+#ifdef _WIN32
+#define ddp_atomic_add64(p, v) InterlockedExchangeAdd64((volatile LONG64 *)(p), (LONG64)(v))
+#define ddp_atomic_inc32(p)    (InterlockedIncrement((volatile LONG *)(p)) - 1)
+#define ddp_atomic_set8(p)     InterlockedExchange8((volatile char *)(p), 1)
+#else
+#define ddp_atomic_add64(p, v) __sync_fetch_and_add((p), (v))
+#define ddp_atomic_inc32(p)    __sync_fetch_and_add((p), 1)
+#define ddp_atomic_set8(p)     __sync_lock_test_and_set((p), 1)
+#endif
+
+struct ddp_archive
+{
+	int format;
+	struct ddp_header header;
+	unit8 *head;//[0, file_offset)的原始数据，含全部索引表，DDP3的文件名直接指向这里
+	unit32 count;
+	//条目的字段按数组分开存放，扫描时只访问需要的字段，全部在同一块内存中
+	unit32 *offset;
+	unit32 *uncomprlen;
+	unit32 *comprlen;
+	unit32 *record;//DDP3索引记录在head中的位置，DDP2为NULL(按序号计算)
+	unit32 *pack;//DDP3所在的pack块，DDP2为NULL
+	unit32 *names;//DDP3文件名的散列表，第一次ddp_find_entry时建立，空位为DDP_NOT_FOUND
+	unit8 *map;//映射失败时为NULL，回退到按偏移读取
+	unit32 size;
+	volatile unit8 *accessed;//ddp_record_access之后每个条目是否读取过，没有记录时为NULL
+	unit32 *access;//按第一次读取的顺序记下的条目
+	volatile unit32 naccess;
+#ifdef _WIN32
+	HANDLE file;
+	HANDLE mapping;
+#else
+	int fd;
+#endif
+};
+
+//HXB的密钥，*len返回需要异或的字节数(不超过datalen - 0x10)
+unit32 ddp_hxb_key(const struct ddp_hxb_header *header, unit32 datalen, unit32 *len);
+//把src的len字节(4的倍数)与key异或后写到dst，dst可以等于src
+void ddp_hxb_xor(unit8 *dst, const unit8 *src, unit32 len, unit32 key);
+//把len字节原样编码为一个字面量token写到dst，返回写出的字节数(最多len + 5)
+unit32 ddp_store_literals(unit8 *dst, const unit8 *src, unit32 len);
+//压缩用的哈希链和最优解析的表，每个线程建一个在多次压缩之间重用，ddp_compress每次都要分配
+struct ddp_cctx;
+struct ddp_cctx *ddp_cctx_create(void);
+void ddp_cctx_free(struct ddp_cctx *c);
+//c为NULL时退回ddp_compress
+unit32 ddp_compress_with(struct ddp_cctx *c, unit8 *compr, unit32 comprlen, unit8 *uncompr, unit32 uncomprlen, int level);
+//解包出的文件的路径，Windows下为UTF-16以容纳DDP3的文件名，其他平台为UTF-8
+#ifdef _WIN32
+typedef WCHAR ddp_pchar;
+#define DDP_PATH_MAX (MAX_PATH * 2)
+#else
+typedef char ddp_pchar;
+#define DDP_PATH_MAX 4096
+#endif
+//解包目录dir(为NULL时为<fname>_unpack)转成ddp_pchar，末尾带分隔符，返回长度，太长时返回0
+//create非0时建立目录；manifest不为NULL时返回清单的路径，都至少有DDP_PATH_MAX个字符
+unit32 ddp_dir_path(const char *fname, const char *dir, int create, ddp_pchar *path, char *manifest);
+//第i个条目解包出的文件名：DDP2为8位序号，DDP3为索引中的文件名，后面加上type的扩展名
+//DDP3文件名会落到解包目录以外时返回DDP_ERR_NAME，path为空字符串
+int ddp_entry_path(const ddp_pchar *dir, unit32 dirlen, const struct ddp_entry *e, unit32 i, int type, ddp_pchar *path);
+//DDP3的文件名中带有目录时，在解包目录中逐级建立
+void ddp_make_parents(ddp_pchar *path, unit32 dirlen);
+FILE *ddp_path_fopen(const ddp_pchar *path, int write);
+//返回修改时间，*size返回文件大小(可以为NULL)；文件不存在时返回-1
+long long ddp_path_mtime(const ddp_pchar *path, unit32 *size);
+//解压的同时解密HXB：离开匹配窗口的数据不会再被引用，趁还在缓存里就地解密
+int ddp_uncompress_hxb(unit8 *uncompr, unit32 uncomprlen, unit8 *compr, unit32 comprlen);
+
+#endif
@@ -0,0 +1,152 @@
+#define _CRT_SECURE_NO_WARNINGS
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "ddp.h"
+
+/*
+布局为文本格式，第一行为"DDP layout 1 条目数"
+之后每行一个序号，按在封包中存放的顺序，可以由ddp_recorded_access记录的读取顺序得到
+*/
+#define DDP_LAYOUT_VERSION 1
+
+int ddp_layout_write(const char *path, ddp_archive *ar, const unit32 *order, unit32 num)
+{
+	FILE *fp;
+	unit32 i;
+	fp = fopen(path, "w");
+	if (fp == NULL)
+		return DDP_ERR_OPEN;
+	fprintf(fp, "DDP layout %d %u\n", DDP_LAYOUT_VERSION, ddp_entry_count(ar));
+	for (i = 0; i < num; i++)
+		fprintf(fp, "%u\n", order[i]);
+	if (fclose(fp) != 0)
+		return DDP_ERR_WRITE;
+	return DDP_OK;
+}
+
+unit32 *ddp_layout_read(const char *path, ddp_archive *ar)
+{
+	FILE *fp;
+	unit32 *order, i, k, num = 0, count;
+	unit8 *seen;
+	int version, ret = EOF;
+	fp = fopen(path, "r");
+	if (fp == NULL)
+		return NULL;
+	if (fscanf(fp, "DDP layout %d %u", &version, &count) != 2 || version != DDP_LAYOUT_VERSION || count != ddp_entry_count(ar))
+	{
+		fclose(fp);
+		return NULL;
+	}
+	order = malloc((count ? count : 1) * sizeof(unit32));
+	seen = calloc(count ? count : 1, 1);
+	while (order != NULL && seen != NULL && (ret = fscanf(fp, "%u", &k)) == 1 && k < count)
+	{
+		if (!seen[k])
+			order[num++] = k;
+		seen[k] = 1;
+	}
+	fclose(fp);
+	if (order == NULL || seen == NULL || ret != EOF)
+	{
+		free(order);
+		free(seen);
+		return NULL;
+	}
+	for (i = 0; i < count; i++)
+		if (!seen[i])
+			order[num++] = i;
+	free(seen);
+	return order;
+}
+
+struct ddp_layout_name
+{
+	const unit8 *name;
+	unit32 len;//UTF-16的字符数，不含结尾的0
+	unit32 i;
+};
+
+//按UTF-16的code unit比较，相同时按序号，排序结果是确定的
+static int ddp_layout_name_cmp(const void *a, const void *b)
+{
+	const struct ddp_layout_name *x = a, *y = b;
+	unit32 k, cx, cy;
+	for (k = 0; k < x->len && k < y->len; k++)
+	{
+		cx = x->name[k * 2] | x->name[k * 2 + 1] << 8;
+		cy = y->name[k * 2] | y->name[k * 2 + 1] << 8;
+		if (cx != cy)
+			return cx < cy ? -1 : 1;
+	}
+	if (x->len != y->len)
+		return x->len < y->len ? -1 : 1;
+	return x->i < y->i ? -1 : x->i > y->i;
+}
+
+static unit32 *ddp_layout_by_name(ddp_archive *ar, unit32 *order)
+{
+	struct ddp_layout_name *names;
+	struct ddp_entry e;
+	unit32 i, count = ddp_entry_count(ar);
+	names = malloc((count ? count : 1) * sizeof(struct ddp_layout_name));
+	if (names == NULL)
+	{
+		free(order);
+		return NULL;
+	}
+	for (i = 0; i < count; i++)
+	{
+		ddp_get_entry(ar, i, &e);
+		names[i].name = e.name;
+		names[i].len = e.name != NULL ? e.namelen / 2 : 0;
+		while (names[i].len > 0 && e.name[names[i].len * 2 - 2] == 0 && e.name[names[i].len * 2 - 1] == 0)
+			names[i].len--;
+		names[i].i = i;
+	}
+	qsort(names, count, sizeof(struct ddp_layout_name), ddp_layout_name_cmp);
+	for (i = 0; i < count; i++)
+		order[i] = names[i].i;
+	free(names);
+	return order;
+}
+
+//按类型计数排序，类型内保持序号的顺序；类型只解压条目开头几个字节判断
+static unit32 *ddp_layout_by_type(ddp_archive *ar, unit32 *order)
+{
+	unit32 start[DDP_TYPE_BIN + 2], i, t, count = ddp_entry_count(ar);
+	unit8 *types = malloc(count ? count : 1);
+	if (types == NULL)
+	{
+		free(order);
+		return NULL;
+	}
+	memset(start, 0, sizeof(start));
+	for (i = 0; i < count; i++)
+	{
+		types[i] = (unit8)ddp_entry_type(ar, i);
+		start[types[i] + 1]++;
+	}
+	for (t = 1; t <= DDP_TYPE_BIN + 1; t++)
+		start[t] += start[t - 1];
+	for (i = 0; i < count; i++)
+		order[start[types[i]]++] = i;
+	free(types);
+	return order;
+}
+
+unit32 *ddp_layout_guess(ddp_archive *ar, int mode)
+{
+	unit32 *order, i, count = ddp_entry_count(ar);
+	order = malloc((count ? count : 1) * sizeof(unit32));
+	if (order == NULL)
+		return NULL;
+	if (mode == DDP_LAYOUT_TYPE)
+		return ddp_layout_by_type(ar, order);
+	if (mode == DDP_LAYOUT_NAME && ddp_archive_format(ar) == DDP_FORMAT_DDP3)
+		return ddp_layout_by_name(ar, order);
+	for (i = 0; i < count; i++)
+		order[i] = i;
+	return order;
+}
@@ -0,0 +1,765 @@
+#define _CRT_SECURE_NO_WARNINGS
+#include <stdlib.h>
+#include <string.h>
+#include "ddp_internal.h"
+#if defined(DDP_AVX2)
+#define DDP_WILDCOPY 32
+#elif defined(DDP_SSE2)
+#define DDP_WILDCOPY 16
+#else
+#define DDP_WILDCOPY 8
+#endif
+
+//逐字节的参考实现，用于校验和对比
+void ddp_uncompress_ref(unit8 *uncompr, unit32 uncomprlen, unit8 *compr, unit32 comprlen)
+{
+	unit32 curbyte = 0, i;
+	unit32 act_uncomprlen = 0;
+	(void)comprlen;//参考实现不检查边界
+	while (act_uncomprlen < uncomprlen)
+	{
+		unit8 flag = compr[curbyte++];
+		unit32 offset, copy_len;
+
+		if (flag < 0x1D)
+		{
+			copy_len = flag + 1;
+			offset = 0;
+		}
+		else if (flag == 0x1D)
+		{
+			copy_len = compr[curbyte++] + 0x1E;
+			offset = 0;
+		}
+		else if (flag == 0x1E)
+		{
+			copy_len = ((compr[curbyte] << 8) | compr[curbyte + 1]) + 0x11E;
+			curbyte += 2;
+			offset = 0;
+		}
+		else if (flag == 0x1F)
+		{
+			copy_len = (compr[curbyte] << 24) | (compr[curbyte + 1] << 16)
+				| (compr[curbyte + 2] << 8) | compr[curbyte + 3];
+			curbyte += 4;
+			offset = 0;
+		}
+		else
+		{
+			if (flag < 0x80)
+			{
+				if ((flag & 0x60) == 0x20)
+				{
+					copy_len = flag & 3;
+					offset = (flag >> 2) & 7;
+				}
+				else if ((flag & 0x60) == 0x40)
+				{
+					copy_len = (flag & 0x1f) + 4;
+					offset = compr[curbyte++];
+				}
+				else
+				{
+					offset = ((flag & 0x1F) << 8) | compr[curbyte++];
+					flag = compr[curbyte++];
+					switch (flag)
+					{
+					case 0xFE:
+						copy_len = ((compr[curbyte] << 8) | compr[curbyte + 1]) + 0x102;
+						curbyte += 2;
+						break;
+					case 0xFF:
+						copy_len = (compr[curbyte] << 24) | (compr[curbyte + 1] << 16) | (compr[curbyte + 2] << 8) | compr[curbyte + 3];
+						curbyte += 4;
+						break;
+					default:
+						copy_len = flag + 4;
+					}
+				}
+			}
+			else
+			{
+				copy_len = (flag >> 5) & 3;
+				offset = ((flag & 0x1F) << 8) | compr[curbyte++];
+			}
+			offset++;
+			copy_len += 3;
+		}
+
+		if (offset)
+		{
+			for (i = 0; i < copy_len; i++)
+			{
+				uncompr[act_uncomprlen] = uncompr[act_uncomprlen - offset];
+				act_uncomprlen++;
+			}
+		}
+		else
+		{
+			for (i = 0; i < copy_len; i++)
+				uncompr[act_uncomprlen++] = compr[curbyte++];
+		}
+	}
+}
+
+//每次复制DDP_WILDCOPY字节直到d >= e，最多多写DDP_WILDCOPY-1字节，要求d - s >= DDP_WILDCOPY
+static void ddp_wildcopy(unit8 *d, const unit8 *s, unit8 *e)
+{
+	do
+	{
+#if DDP_WILDCOPY == 32
+		_mm256_storeu_si256((__m256i *)d, _mm256_loadu_si256((const __m256i *)s));
+#elif DDP_WILDCOPY == 16
+		_mm_storeu_si128((__m128i *)d, _mm_loadu_si128((const __m128i *)s));
+#else
+		memcpy(d, s, 8);
+#endif
+		d += DDP_WILDCOPY;
+		s += DDP_WILDCOPY;
+	} while (d < e);
+}
+
+static void ddp_copy_match(unit8 *op, unit32 offset, unit32 len, unit8 *oend)
+{
+	unit8 *match = op - offset, *cpy = op + len, pat[8];
+	unit32 i, eff;
+	if (cpy > oend || oend - cpy < DDP_WILDCOPY)//靠近缓冲末尾，逐字节复制
+	{
+		while (op < cpy)
+			*op++ = *match++;
+		return;
+	}
+	if (offset >= DDP_WILDCOPY)
+		ddp_wildcopy(op, match, cpy);
+	else if (offset == 1)
+		memset(op, *match, len);
+	else if (offset == 2 || offset == 4)
+	{
+		for (i = 0; i < 8; i++)
+			pat[i] = match[i % offset];
+		do
+		{
+			memcpy(op, pat, 8);
+			op += 8;
+		} while (op < cpy);
+	}
+	else if (offset < 8)
+	{
+		//数据以offset为周期重复，先逐字节写出eff - offset字节，之后按不小于8的有效偏移eff整块复制
+		eff = offset * ((8 + offset - 1) / offset);
+		for (i = 0; i < eff - offset && op < cpy; i++)
+			*op++ = *match++;
+		while (op < cpy)
+		{
+			memcpy(op, op - eff, 8);
+			op += 8;
+		}
+	}
+	else
+	{
+		do
+		{
+			memcpy(op, match, 8);
+			op += 8;
+			match += 8;
+		} while (op < cpy);
+	}
+}
+
+enum
+{
+	DDP_DECODE_FAST = 0,//完全信任输入
+	DDP_DECODE_SAFE,//每个token检查一次输入剩余、偏移和输出剩余，不做逐字节检查
+	DDP_DECODE_PARTIAL//同SAFE，但输出写满后截断最后一个token并停止，而不是报错
+};
+
+//调用者传入的safe都是常量，编译器会为它们各自生成一份去掉无用分支的代码
+#define DDP_NEED(n) if (safe && ip >= ilimit && (unit32)(iend - ip) < (unit32)(n)) { ret = DDP_ERR_TRUNCATED; break; }
+#define DDP_HXB_STEP 0x4000//每多输出这么多字节解密一次
+
+//已输出的前0x10字节是HXB文件头时返回密钥，*dec_end为需要解密的结尾，否则*dec_end为0
+static unit32 ddp_hxb_begin(unit8 *uncompr, unit32 uncomprlen, unit32 *dec_end)
+{
+	unit32 key;
+	*dec_end = 0;
+	if (ddp_sniff(uncompr, 0x10) != DDP_TYPE_HXB)
+		return 0;
+	key = ddp_hxb_key((const struct ddp_hxb_header *)uncompr, uncomprlen, dec_end);
+	*dec_end += 0x10;
+	return key;
+}
+
+//hxb为1时，输出够0x10字节后检查是否为HXB，是的话把已经离开匹配窗口的数据分批解密
+static int ddp_decode(unit8 *uncompr, unit32 uncomprlen, unit8 *compr, unit32 comprlen, int safe, int hxb, unit32 *outlen)
+{
+	unit8 *op = uncompr, *oend = uncompr + uncomprlen, *ip = compr, *iend = compr + comprlen;
+	unit8 *ilimit = comprlen > 8 ? iend - 8 : compr;//token头最长7字节，离输入末尾超过8字节时不用检查
+	unit8 flag;
+	unit32 offset, copy_len, key = 0, dec = 0x10, dec_end = 0, next = 0x10;
+	int ret = DDP_OK;
+	while (op < oend)
+	{
+		if (hxb && (unit32)(op - uncompr) >= next)
+		{
+			if (next == 0x10)
+				key = ddp_hxb_begin(uncompr, uncomprlen, &dec_end);
+			else
+			{
+				offset = (unit32)(op - uncompr) - DDP_WINDOW;
+				offset = offset < dec_end ? offset : dec_end;
+				offset = dec + ((offset - dec) & ~3u);
+				ddp_hxb_xor(uncompr + dec, uncompr + dec, offset - dec, key);
+				dec = offset;
+			}
+			next = dec_end > dec ? (unit32)(op - uncompr) + DDP_HXB_STEP : 0xFFFFFFFF;
+			if (next < dec + DDP_WINDOW + DDP_HXB_STEP)
+				next = dec + DDP_WINDOW + DDP_HXB_STEP;
+		}
+		DDP_NEED(1);
+		flag = *ip++;
+		if (flag < 0x20)
+		{
+			if (flag < 0x1D)
+				copy_len = flag + 1;
+			else if (flag == 0x1D)
+			{
+				DDP_NEED(1);
+				copy_len = *ip++ + 0x1E;
+			}
+			else if (flag == 0x1E)
+			{
+				DDP_NEED(2);
+				copy_len = ((ip[0] << 8) | ip[1]) + 0x11E;
+				ip += 2;
+			}
+			else
+			{
+				DDP_NEED(4);
+				copy_len = ((unit32)ip[0] << 24) | (ip[1] << 16) | (ip[2] << 8) | ip[3];
+				ip += 4;
+			}
+			if (safe)
+			{
+				if (copy_len > (unit32)(oend - op))
+				{
+					if (safe != DDP_DECODE_PARTIAL)
+					{
+						ret = DDP_ERR_OVERFLOW;
+						break;
+					}
+					copy_len = (unit32)(oend - op);
+				}
+				if (copy_len > (unit32)(iend - ip))
+				{
+					ret = DDP_ERR_TRUNCATED;
+					break;
+				}
+			}
+			//短的字面量在两端都有余量时按16字节定长复制
+			if (copy_len <= 16 && oend - op >= 16 && iend - ip >= 16)
+				memcpy(op, ip, 16);
+			else
+				memcpy(op, ip, copy_len);
+			op += copy_len;
+			ip += copy_len;
+			continue;
+		}
+		if (flag < 0x80)
+		{
+			if ((flag & 0x60) == 0x20)
+			{
+				copy_len = flag & 3;
+				offset = (flag >> 2) & 7;
+			}
+			else if ((flag & 0x60) == 0x40)
+			{
+				DDP_NEED(1);
+				copy_len = (flag & 0x1f) + 4;
+				offset = *ip++;
+			}
+			else
+			{
+				DDP_NEED(2);
+				offset = ((flag & 0x1F) << 8) | *ip++;
+				flag = *ip++;
+				if (flag == 0xFE)
+				{
+					DDP_NEED(2);
+					copy_len = ((ip[0] << 8) | ip[1]) + 0x102;
+					ip += 2;
+				}
+				else if (flag == 0xFF)
+				{
+					DDP_NEED(4);
+					copy_len = ((unit32)ip[0] << 24) | (ip[1] << 16) | (ip[2] << 8) | ip[3];
+					ip += 4;
+				}
+				else
+					copy_len = flag + 4;
+			}
+		}
+		else
+		{
+			DDP_NEED(1);
+			copy_len = (flag >> 5) & 3;
+			offset = ((flag & 0x1F) << 8) | *ip++;
+		}
+		offset++;
+		copy_len += 3;
+		if (safe)
+		{
+			if (offset > (unit32)(op - uncompr))
+			{
+				ret = DDP_ERR_OFFSET;
+				break;
+			}
+			//0xFF形式的长度为32位，加3后可能回绕
+			if (copy_len < 3 || copy_len > (unit32)(oend - op))
+			{
+				if (safe != DDP_DECODE_PARTIAL)
+				{
+					ret = DDP_ERR_OVERFLOW;
+					break;
+				}
+				copy_len = (unit32)(oend - op);
+			}
+		}
+		ddp_copy_match(op, offset, copy_len, oend);
+		op += copy_len;
+	}
+	if (hxb && ret == DDP_OK)
+	{
+		//最后一个token才输出够0x10字节时循环里没来得及检查
+		if (next == 0x10 && uncomprlen >= 0x10)
+			key = ddp_hxb_begin(uncompr, uncomprlen, &dec_end);
+		if (dec_end > dec)
+			ddp_hxb_xor(uncompr + dec, uncompr + dec, dec_end - dec, key);
+	}
+	if (outlen != NULL)
+		*outlen = (unit32)(op - uncompr);
+	return ret;
+}
+
+#undef DDP_NEED
+
+void ddp_uncompress(unit8 *uncompr, unit32 uncomprlen, unit8 *compr, unit32 comprlen)
+{
+	ddp_decode(uncompr, uncomprlen, compr, comprlen, DDP_DECODE_FAST, 0, NULL);
+}
+
+int ddp_uncompress_safe(unit8 *uncompr, unit32 uncomprlen, unit8 *compr, unit32 comprlen)
+{
+	return ddp_decode(uncompr, uncomprlen, compr, comprlen, DDP_DECODE_SAFE, 0, NULL);
+}
+
+int ddp_uncompress_hxb(unit8 *uncompr, unit32 uncomprlen, unit8 *compr, unit32 comprlen)
+{
+	return ddp_decode(uncompr, uncomprlen, compr, comprlen, DDP_DECODE_SAFE, 1, NULL);
+}
+
+unit32 ddp_uncompress_partial(unit8 *uncompr, unit32 len, unit8 *compr, unit32 comprlen)
+{
+	unit32 got;
+	ddp_decode(uncompr, len, compr, comprlen, DDP_DECODE_PARTIAL, 0, &got);
+	return got;
+}
+
+#define DDP_HASH_LOG   15
+#define DDP_MIN_MATCH  3
+#define DDP_MAX_MATCHES 16
+#define DDP_OPT_NUM    4096
+
+struct ddp_match
+{
+	unit32 off;
+	unit32 len;
+};
+
+struct ddp_node
+{
+	unit32 price;//到此位置的最小输出字节数
+	unit32 litlen;
+	unit32 off;
+	unit32 len;//0表示由字面量到达
+};
+
+struct ddp_seq
+{
+	unit32 pos;
+	unit32 off;
+	unit32 len;
+};
+
+struct ddp_cctx
+{
+	unit8 *src;
+	unit32 srclen;
+	unit32 next;//下一个待插入哈希链的位置
+	unit8 *dst;
+	unit32 dstlen;
+	unit32 dstpos;
+	int head[1 << DDP_HASH_LOG];
+	int prev[DDP_WINDOW];
+	struct ddp_node opt[DDP_OPT_NUM + 1];
+	struct ddp_seq seq[DDP_OPT_NUM / DDP_MIN_MATCH + 1];
+};
+
+static unit32 ddp_hash(unit8 *p)
+{
+	return ((unit32)(p[0] << 16 | p[1] << 8 | p[2]) * 2654435761u) >> (32 - DDP_HASH_LOG);
+}
+
+static void ddp_insert_upto(struct ddp_cctx *c, unit32 target)
+{
+	while (c->next < target)
+	{
+		if (c->next + DDP_MIN_MATCH <= c->srclen)
+		{
+			unit32 h = ddp_hash(c->src + c->next);
+			c->prev[c->next & (DDP_WINDOW - 1)] = c->head[h];
+			c->head[h] = c->next;
+		}
+		c->next++;
+	}
+}
+
+//沿哈希链查找pos处的匹配，按长度递增记录，同一长度只保留最近的偏移
+static unit32 ddp_find_matches(struct ddp_cctx *c, unit32 pos, unit32 depth, unit32 nice, struct ddp_match *m, unit32 max_m)
+{
+	unit8 *src = c->src;
+	unit32 limit = c->srclen - pos, best = DDP_MIN_MATCH - 1, cnt = 0, len;
+	int cand;
+	ddp_insert_upto(c, pos);
+	cand = c->head[ddp_hash(src + pos)];
+	while (cand >= 0 && depth-- > 0)
+	{
+		if (pos - cand > DDP_WINDOW)
+			break;
+		if (src[cand + best] == src[pos + best])
+		{
+			len = 0;
+			while (len < limit && src[cand + len] == src[pos + len])
+				len++;
+			if (len > best)
+			{
+				best = len;
+				if (cnt == max_m)
+					cnt--;
+				m[cnt].off = pos - cand;
+				m[cnt].len = len;
+				cnt++;
+				if (len >= nice || len == limit)
+					break;
+			}
+		}
+		cand = c->prev[cand & (DDP_WINDOW - 1)];
+	}
+	return cnt;
+}
+
+static unit32 ddp_literal_cost(unit32 run)
+{
+	if (run == 0)
+		return 0;
+	if (run <= 0x1D)
+		return 1;
+	if (run <= 0x11D)
+		return 2;
+	if (run <= 0x11D + 0xFFFF)
+		return 3;
+	return 5;
+}
+
+static unit32 ddp_match_cost(unit32 off, unit32 len)
+{
+	if (len <= 6)
+		return off <= 8 ? 1 : 2;
+	if (len <= 38 && off <= 0x100)
+		return 2;
+	if (len <= 260)
+		return 3;
+	if (len <= 0x105 + 0xFFFF)
+		return 5;
+	return 7;
+}
+
+static void ddp_put(struct ddp_cctx *c, unit8 b)
+{
+	if (c->dstpos < c->dstlen)
+		c->dst[c->dstpos] = b;
+	c->dstpos++;
+}
+
+static void ddp_put16(struct ddp_cctx *c, unit32 v)
+{
+	ddp_put(c, (unit8)(v >> 8));
+	ddp_put(c, (unit8)v);
+}
+
+static void ddp_put32(struct ddp_cctx *c, unit32 v)
+{
+	ddp_put16(c, v >> 16);
+	ddp_put16(c, v);
+}
+
+static void ddp_emit_literals(struct ddp_cctx *c, unit32 start, unit32 run)
+{
+	if (run == 0)
+		return;
+	if (run <= 0x1D)
+		ddp_put(c, (unit8)(run - 1));
+	else if (run <= 0x11D)
+	{
+		ddp_put(c, 0x1D);
+		ddp_put(c, (unit8)(run - 0x1E));
+	}
+	else if (run <= 0x11D + 0xFFFF)
+	{
+		ddp_put(c, 0x1E);
+		ddp_put16(c, run - 0x11E);
+	}
+	else
+	{
+		ddp_put(c, 0x1F);
+		ddp_put32(c, run);
+	}
+	if (c->dstpos + run <= c->dstlen)
+		memcpy(c->dst + c->dstpos, c->src + start, run);
+	c->dstpos += run;
+}
+
+static void ddp_emit_match(struct ddp_cctx *c, unit32 off, unit32 len)
+{
+	off--;
+	if (len <= 6)
+	{
+		if (off < 8)
+			ddp_put(c, (unit8)(0x20 | off << 2 | (len - 3)));
+		else
+		{
+			ddp_put(c, (unit8)(0x80 | (len - 3) << 5 | off >> 8));
+			ddp_put(c, (unit8)off);
+		}
+	}
+	else if (len <= 38 && off < 0x100)
+	{
+		ddp_put(c, (unit8)(0x40 | (len - 7)));
+		ddp_put(c, (unit8)off);
+	}
+	else
+	{
+		ddp_put(c, (unit8)(0x60 | off >> 8));
+		ddp_put(c, (unit8)off);
+		if (len <= 260)
+			ddp_put(c, (unit8)(len - 7));
+		else if (len <= 0x105 + 0xFFFF)
+		{
+			ddp_put(c, 0xFE);
+			ddp_put16(c, len - 0x105);
+		}
+		else
+		{
+			ddp_put(c, 0xFF);
+			ddp_put32(c, len - 3);
+		}
+	}
+}
+
+static int ddp_match_gain(struct ddp_match *m)
+{
+	return (int)m->len - (int)ddp_match_cost(m->off, m->len);
+}
+
+static void ddp_compress_greedy(struct ddp_cctx *c, unit32 depth, unit32 nice, int lazy)
+{
+	struct ddp_match cur, next;
+	unit32 pos = 0, anchor = 0, n = c->srclen;
+	while (pos + DDP_MIN_MATCH <= n && c->dstpos <= c->dstlen)
+	{
+		if (!ddp_find_matches(c, pos, depth, nice, &cur, 1))
+		{
+			pos++;
+			continue;
+		}
+		//后一个位置的匹配更划算就先输出一个字面量
+		while (lazy && cur.len < nice && pos + 1 + DDP_MIN_MATCH <= n
+			&& ddp_find_matches(c, pos + 1, depth, nice, &next, 1) && ddp_match_gain(&next) > ddp_match_gain(&cur))
+		{
+			pos++;
+			cur = next;
+		}
+		ddp_emit_literals(c, anchor, pos - anchor);
+		ddp_emit_match(c, cur.off, cur.len);
+		pos += cur.len;
+		anchor = pos;
+	}
+	ddp_emit_literals(c, anchor, n - anchor);
+}
+
+static void ddp_compress_optimal(struct ddp_cctx *c, unit32 depth, unit32 nice)
+{
+	struct ddp_match m[DDP_MAX_MATCHES];
+	struct ddp_node *opt = c->opt;
+	unit32 n = c->srclen, anchor = 0, start = 0;
+	unit32 i, j, l, k, cnt, last, price, prevlen, len, seqnum;
+	while (start + DDP_MIN_MATCH <= n && c->dstpos <= c->dstlen)
+	{
+		struct ddp_match cut = { 0, 0 };//足够长的匹配直接截断本段
+		last = n - start < DDP_OPT_NUM ? n - start : DDP_OPT_NUM;
+		opt[0].price = 0;
+		opt[0].litlen = start - anchor;
+		opt[0].len = 0;
+		for (i = 1; i <= last; i++)
+			opt[i].price = 0xFFFFFFFF;
+		for (i = 0; i < last; i++)
+		{
+			price = opt[i].price + 1 + ddp_literal_cost(opt[i].litlen + 1) - ddp_literal_cost(opt[i].litlen);
+			if (price < opt[i + 1].price)
+			{
+				opt[i + 1].price = price;
+				opt[i + 1].litlen = opt[i].litlen + 1;
+				opt[i + 1].len = 0;
+			}
+			if (start + i + DDP_MIN_MATCH > n)
+				continue;
+			cnt = ddp_find_matches(c, start + i, depth, nice, m, DDP_MAX_MATCHES);
+			if (cnt && m[cnt - 1].len >= nice)
+			{
+				cut = m[cnt - 1];
+				last = i;
+				break;
+			}
+			prevlen = DDP_MIN_MATCH - 1;
+			for (j = 0; j < cnt; j++)
+			{
+				len = m[j].len < last - i ? m[j].len : last - i;
+				for (l = prevlen + 1; l <= len; l++)
+				{
+					price = opt[i].price + ddp_match_cost(m[j].off, l);
+					if (price < opt[i + l].price)
+					{
+						opt[i + l].price = price;
+						opt[i + l].litlen = 0;
+						opt[i + l].off = m[j].off;
+						opt[i + l].len = l;
+					}
+				}
+				if (len > prevlen)
+					prevlen = len;
+			}
+		}
+		seqnum = 0;
+		for (k = last; k > 0; )
+		{
+			if (opt[k].len == 0)
+				k--;
+			else
+			{
+				c->seq[seqnum].off = opt[k].off;
+				c->seq[seqnum].len = opt[k].len;
+				k -= opt[k].len;
+				c->seq[seqnum].pos = start + k;
+				seqnum++;
+			}
+		}
+		while (seqnum-- > 0)
+		{
+			ddp_emit_literals(c, anchor, c->seq[seqnum].pos - anchor);
+			ddp_emit_match(c, c->seq[seqnum].off, c->seq[seqnum].len);
+			anchor = c->seq[seqnum].pos + c->seq[seqnum].len;
+		}
+		start += last;
+		if (cut.len)
+		{
+			ddp_emit_literals(c, anchor, start - anchor);
+			ddp_emit_match(c, cut.off, cut.len);
+			start += cut.len;
+			anchor = start;
+		}
+	}
+	ddp_emit_literals(c, anchor, n - anchor);
+}
+
+unit32 ddp_store_literals(unit8 *dst, const unit8 *src, unit32 len)
+{
+	unit32 n;
+	if (len == 0)
+		return 0;
+	if (len <= 0x1D)
+	{
+		dst[0] = (unit8)(len - 1);
+		n = 1;
+	}
+	else if (len <= 0x11D)
+	{
+		dst[0] = 0x1D;
+		dst[1] = (unit8)(len - 0x1E);
+		n = 2;
+	}
+	else if (len <= 0x11D + 0xFFFF)
+	{
+		dst[0] = 0x1E;
+		dst[1] = (unit8)((len - 0x11E) >> 8);
+		dst[2] = (unit8)(len - 0x11E);
+		n = 3;
+	}
+	else
+	{
+		dst[0] = 0x1F;
+		dst[1] = (unit8)(len >> 24);
+		dst[2] = (unit8)(len >> 16);
+		dst[3] = (unit8)(len >> 8);
+		dst[4] = (unit8)len;
+		n = 5;
+	}
+	memcpy(dst + n, src, len);
+	return n + len;
+}
+
+struct ddp_cctx *ddp_cctx_create(void)
+{
+	return ddp_alloc_aligned(sizeof(struct ddp_cctx), 64);
+}
+
+void ddp_cctx_free(struct ddp_cctx *c)
+{
+	if (c != NULL)
+		ddp_free_aligned(c);
+}
+
+unit32 ddp_compress_with(struct ddp_cctx *c, unit8 *compr, unit32 comprlen, unit8 *uncompr, unit32 uncomprlen, int level)
+{
+	if (level == DDP_LEVEL_STORE || uncomprlen == 0)
+		return 0;
+	if (c == NULL)
+		return ddp_compress(compr, comprlen, uncompr, uncomprlen, level);
+	memset(c->head, 0xFF, sizeof(c->head));
+	c->src = uncompr;
+	c->srclen = uncomprlen;
+	c->next = 0;
+	c->dst = compr;
+	c->dstlen = comprlen;
+	c->dstpos = 0;
+	if (level == DDP_LEVEL_FAST)
+		ddp_compress_greedy(c, 4, 16, 0);
+	else if (level == DDP_LEVEL_LAZY)
+		ddp_compress_greedy(c, 32, 64, 1);
+	else
+		ddp_compress_optimal(c, 128, 128);
+	return c->dstpos <= c->dstlen ? c->dstpos : 0;
+}
+
+//ddp_uncompress的逆过程，返回压缩后的长度，放不进comprlen字节时返回0(即按原样存储)
+unit32 ddp_compress(unit8 *compr, unit32 comprlen, unit8 *uncompr, unit32 uncomprlen, int level)
+{
+	struct ddp_cctx *c;
+	unit32 ret;
+	if (level == DDP_LEVEL_STORE || uncomprlen == 0)
+		return 0;
+	c = ddp_cctx_create();
+	if (c == NULL)
+		return 0;
+	ret = ddp_compress_with(c, compr, comprlen, uncompr, uncomprlen, level);
+	ddp_cctx_free(c);
+	return ret;
+}
@@ -0,0 +1,84 @@
+#define _CRT_SECURE_NO_WARNINGS
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "ddp.h"
+
+/*
+清单为文本格式，第一行为"DDP manifest 2 条目数 封包大小"
+之后每行一个条目："序号 扩展名 解包出的文件大小 修改时间 内容的哈希"
+*/
+#define DDP_MANIFEST_VERSION 2
+
+#define DDP_ROTL64(x, r) (((x) << (r)) | ((x) >> (64 - (r))))
+
+unsigned long long ddp_hash64(const unit8 *data, unit32 len)
+{
+	unsigned long long h = 0x9E3779B97F4A7C15ull ^ len, v;
+	for (; len >= 8; len -= 8, data += 8)
+	{
+		memcpy(&v, data, 8);
+		h ^= v * 0xC2B2AE3D27D4EB4Full;
+		h = DDP_ROTL64(h, 31) * 0x9E3779B185EBCA87ull;
+	}
+	v = 0;
+	memcpy(&v, data, len);
+	h ^= v * 0xC2B2AE3D27D4EB4Full;
+	h = DDP_ROTL64(h, 31) * 0x9E3779B185EBCA87ull;
+	h ^= h >> 33;
+	h *= 0xFF51AFD7ED558CCDull;
+	h ^= h >> 33;
+	h *= 0xC4CEB9FE1A85EC53ull;
+	h ^= h >> 33;
+	return h;
+}
+
+int ddp_manifest_write(const char *path, ddp_archive *ar, const struct ddp_manifest_entry *entries)
+{
+	FILE *fp;
+	unit32 i, count = ddp_entry_count(ar);
+	fp = fopen(path, "w");
+	if (fp == NULL)
+		return DDP_ERR_OPEN;
+	fprintf(fp, "DDP manifest %d %u %u\n", DDP_MANIFEST_VERSION, count, ddp_archive_header(ar)->filesize);
+	for (i = 0; i < count; i++)
+		fprintf(fp, "%u %s %u %lld %016llx\n", i, ddp_type_ext(entries[i].type), entries[i].size, entries[i].mtime, entries[i].hash);
+	if (fclose(fp) != 0)
+		return DDP_ERR_WRITE;
+	return DDP_OK;
+}
+
+struct ddp_manifest_entry *ddp_manifest_read(const char *path, ddp_archive *ar)
+{
+	FILE *fp;
+	struct ddp_manifest_entry *entries;
+	unit32 i, k, count, filesize;
+	char ext[16];
+	int version, type;
+	fp = fopen(path, "r");
+	if (fp == NULL)
+		return NULL;
+	if (fscanf(fp, "DDP manifest %d %u %u", &version, &count, &filesize) != 3 || version != DDP_MANIFEST_VERSION
+		|| count != ddp_entry_count(ar) || filesize != ddp_archive_header(ar)->filesize)
+	{
+		fclose(fp);
+		return NULL;
+	}
+	entries = malloc((count ? count : 1) * sizeof(struct ddp_manifest_entry));
+	for (i = 0; entries != NULL && i < count; i++)
+	{
+		if (fscanf(fp, "%u %15s %u %lld %llx", &k, ext, &entries[i].size, &entries[i].mtime, &entries[i].hash) != 5 || k != i)
+			break;
+		for (type = DDP_TYPE_HXB; type < DDP_TYPE_BIN; type++)
+			if (strcmp(ext, ddp_type_ext(type)) == 0)
+				break;
+		entries[i].type = (unit8)type;
+	}
+	fclose(fp);
+	if (entries != NULL && i != count)
+	{
+		free(entries);
+		entries = NULL;
+	}
+	return entries;
+}
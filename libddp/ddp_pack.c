@@ -0,0 +1,223 @@
+#define _CRT_SECURE_NO_WARNINGS
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "ddp_internal.h"
+
+//多线程压缩时keep和load会同时调用，路径都放在调用者的栈上
+struct ddp_pack_ctx
+{
+	ddp_archive *ar;
+	struct ddp_pack_params *params;
+	ddp_pchar dir[DDP_PATH_MAX];
+	unit32 dirlen;
+	struct ddp_manifest_entry *manifest;//解包时写出的清单，没有时为NULL
+	unit8 *types;//没有清单时读取原条目判断的类型，0xFF为还没判断
+	ddp_bufpool *bufs;//读入文件的缓冲，条目写出后归还，给后面的条目重用
+};
+
+//按原条目的类型得到解包出的文件名，返回类型
+static int ddp_pack_path(struct ddp_pack_ctx *pc, unit32 i, ddp_pchar *path)
+{
+	struct ddp_entry e;
+	int type;
+	if (pc->manifest != NULL)
+		type = pc->manifest[i].type;
+	else
+	{
+		if (pc->types[i] == 0xFF)
+			pc->types[i] = (unit8)ddp_entry_type(pc->ar, i);
+		type = pc->types[i];
+	}
+	ddp_entry_path(pc->dir, pc->dirlen, ddp_get_entry(pc->ar, i, &e), i, type, path);
+	return type;
+}
+
+static unit8 *ddp_read_file(ddp_bufpool *bufs, const ddp_pchar *path, unit32 *len)
+{
+	FILE *src;
+	unit8 *data;
+	src = ddp_path_fopen(path, 0);
+	if (src == NULL)
+		return NULL;
+	fseek(src, 0, SEEK_END);
+	*len = ftell(src);
+	fseek(src, 0, SEEK_SET);
+	data = ddp_bufpool_get(bufs, *len);
+	if (data != NULL && *len != 0 && fread(data, *len, 1, src) != 1)
+	{
+		ddp_bufpool_put(bufs, data);
+		data = NULL;
+	}
+	fclose(src);
+	return data;
+}
+
+//文件大小和修改时间都与清单相同时认为没有改动，只有修改时间不同时再比较内容的哈希
+static int ddp_pack_keep(void *ctx, ddp_archive *ar, unit32 i)
+{
+	struct ddp_pack_ctx *pc = ctx;
+	struct ddp_manifest_entry *m = &pc->manifest[i];
+	ddp_pchar path[DDP_PATH_MAX];
+	unit8 *data;
+	unit32 len, size;
+	long long mtime;
+	int same;
+	(void)ar;
+	ddp_pack_path(pc, i, path);
+	mtime = ddp_path_mtime(path, &size);
+	if (mtime == -1 || size != m->size)
+		return 0;
+	if (mtime == m->mtime)
+		return 1;
+	data = ddp_read_file(pc->bufs, path, &len);
+	same = data != NULL && len == m->size && ddp_hash64(data, len) == m->hash;
+	ddp_bufpool_put(pc->bufs, data);
+	return same;
+}
+
+//按原条目的类型找到解包出的文件，读入后作为新内容；有清单时记录新内容的指纹，-patch后写回
+static unit8 *ddp_pack_load(void *ctx, ddp_archive *ar, unit32 i, unit32 *len)
+{
+	struct ddp_pack_ctx *pc = ctx;
+	struct ddp_manifest_entry *m;
+	ddp_pchar path[DDP_PATH_MAX];
+	struct ddp_hxb_header hxb_header;
+	unit8 *udata;
+	int type;
+	(void)ar;
+	if (pc->params->cancel != NULL && *pc->params->cancel)
+		return NULL;//ddp_write随之停止，ddp_pack_archive再换成DDP_ERR_CANCELLED
+	type = ddp_pack_path(pc, i, path);
+	udata = ddp_read_file(pc->bufs, path, len);
+	if (udata == NULL)
+	{
+		pc->params->missing = i;
+		return NULL;
+	}
+	if (pc->manifest != NULL)
+	{
+		m = &pc->manifest[i];
+		m->size = *len;
+		m->mtime = ddp_path_mtime(path, NULL);
+		m->hash = ddp_hash64(udata, *len);
+	}
+	if (type == DDP_TYPE_HXB && *len >= 0x10)
+	{
+		memcpy(&hxb_header, udata, 0x10);
+		ddp_hxb_encrypt(&hxb_header, udata, *len);
+	}
+	return udata;
+}
+
+static void ddp_pack_release(void *ctx, unit8 *data)
+{
+	ddp_bufpool_put(((struct ddp_pack_ctx *)ctx)->bufs, data);
+}
+
+static void ddp_pack_done(void *ctx, unit32 i, unit8 *data, const struct ddp_entry *e)
+{
+	struct ddp_pack_ctx *pc = ctx;
+	ddp_pchar path[DDP_PATH_MAX];
+	int type = ddp_pack_path(pc, i, path);
+	ddp_stats_entry(pc->params->stats, type, e->uncomprlen, e->comprlen != 0 ? e->comprlen : e->uncomprlen, e->comprlen == 0);
+	if (data == NULL)
+		pc->params->kept++;
+	ddp_bufpool_put(pc->bufs, data);
+	if (pc->params->done != NULL)
+		pc->params->done(pc->params->ctx, i, e, data == NULL);
+}
+
+int ddp_pack_archive(ddp_archive *ar, const char *fname, const char *dir, const char *outname, struct ddp_pack_params *params)
+{
+	struct ddp_pack_ctx pc;
+	struct ddp_write_params wp;
+	char manifest[DDP_PATH_MAX];
+	unit32 maxlen, maxclen, count = ddp_entry_count(ar);
+	int err;
+	memset(&pc, 0, sizeof(pc));
+	pc.ar = ar;
+	pc.params = params;
+	params->kept = 0;
+	params->missing = DDP_NOT_FOUND;
+	params->has_manifest = 0;
+	pc.dirlen = ddp_dir_path(fname, dir, 0, pc.dir, manifest);
+	if (pc.dirlen == 0)
+		return DDP_ERR_OPEN;
+	pc.manifest = ddp_manifest_read(manifest, ar);
+	if (pc.manifest == NULL && params->patch)
+		return DDP_ERR_PATCH;
+	if (pc.manifest == NULL)
+	{
+		pc.types = malloc(count + 1);
+		if (pc.types == NULL)
+			return DDP_ERR_NOMEM;
+		memset(pc.types, 0xFF, count + 1);
+	}
+	params->has_manifest = pc.manifest != NULL;
+	ddp_max_lengths(ar, &maxlen, &maxclen);
+	pc.bufs = ddp_bufpool_create(maxlen);
+	if (pc.bufs == NULL)
+	{
+		free(pc.manifest);
+		free(pc.types);
+		return DDP_ERR_NOMEM;
+	}
+	memset(&wp, 0, sizeof(wp));
+	wp.level = params->level;
+	wp.threads = params->threads;
+	wp.budget = params->budget;
+	wp.dedup = params->dedup;
+	wp.order = params->order;
+	wp.stats = params->stats;
+	wp.load = ddp_pack_load;
+	wp.done = ddp_pack_done;
+	wp.release = ddp_pack_release;
+	wp.keep = (params->incremental || params->patch) && pc.manifest != NULL ? ddp_pack_keep : NULL;
+	wp.ctx = &pc;
+	if (params->patch)
+	{
+		err = ddp_patch_archive(ar, fname, &wp);
+		if (err == DDP_OK)
+			err = ddp_manifest_write(manifest, ar, pc.manifest);//封包大小变了，清单要一起更新
+	}
+	else
+		err = ddp_write_archive(ar, outname, &wp);
+	if (err != DDP_OK && err != DDP_ERR_SAME_FILE && params->cancel != NULL && *params->cancel)
+	{
+		err = DDP_ERR_CANCELLED;
+		if (!params->patch)
+			remove(outname);
+	}
+	params->filesize = wp.filesize;
+	params->saved = wp.saved;
+	free(pc.manifest);
+	free(pc.types);
+	ddp_bufpool_free(pc.bufs);
+	return err;
+}
+
+int ddp_pack_compact(const char *fname, const char *dir, unit32 *saved)
+{
+	ddp_archive *ar;
+	struct ddp_manifest_entry *entries;
+	ddp_pchar path[DDP_PATH_MAX];
+	char manifest[DDP_PATH_MAX];
+	int err;
+	if (ddp_dir_path(fname, dir, 0, path, manifest) == 0)
+		return DDP_ERR_OPEN;
+	ar = ddp_open(fname, &err);
+	if (ar == NULL)
+		return err;
+	entries = ddp_manifest_read(manifest, ar);
+	ddp_close(ar);
+	err = ddp_compact_archive(fname, saved);
+	//清单记录了封包大小，整理后要写回，否则下次打包时会被当作与封包不符
+	if (err == DDP_OK && entries != NULL && (ar = ddp_open(fname, &err)) != NULL)
+	{
+		err = ddp_manifest_write(manifest, ar, entries);
+		ddp_close(ar);
+	}
+	free(entries);
+	return err;
+}
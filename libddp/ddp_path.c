@@ -0,0 +1,180 @@
+#define _CRT_SECURE_NO_WARNINGS
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#ifdef _WIN32
+#include <direct.h>
+#else
+#include <sys/types.h>
+#endif
+#include "ddp_internal.h"
+
+unit32 ddp_dir_path(const char *fname, const char *dir, int create, ddp_pchar *path, char *manifest)
+{
+	char buf[DDP_PATH_MAX];
+	size_t len = dir != NULL ? strlen(dir) : strlen(fname) + 7;
+	unit32 n;
+	if (len + 2 + sizeof(DDP_MANIFEST_NAME) > DDP_PATH_MAX)
+		return 0;
+	if (dir != NULL)
+		strcpy(buf, dir);
+	else
+		sprintf(buf, "%s_unpack", fname);
+	while (len > 1 && (buf[len - 1] == '/' || buf[len - 1] == '\\'))
+		buf[--len] = 0;
+	if (create)
+	{
+#ifdef _WIN32
+		_mkdir(buf);
+#else
+		mkdir(buf, 0777);
+#endif
+	}
+	if (manifest != NULL)
+		sprintf(manifest, "%s/%s", buf, DDP_MANIFEST_NAME);
+#ifdef _WIN32
+	n = MultiByteToWideChar(CP_ACP, 0, buf, -1, path, DDP_PATH_MAX - 1);
+	if (n == 0)
+		return 0;
+	path[n - 1] = '\\';
+#else
+	memcpy(path, buf, len);
+	path[len] = '/';
+	n = (unit32)len + 1;
+#endif
+	return n;
+}
+
+//文件名中不能有..和只由点、空格组成的目录(Windows会去掉末尾的点和空格)，不能以分隔符开头，不能有盘符或其他冒号
+static int ddp_safe_name(const unit8 *name, unit32 namelen)
+{
+	unit32 k, c, len = 0, dots = 1;//len、dots为当前这一级的字符数和是否只有点和空格
+	for (k = 0; k + 1 < namelen; k += 2)
+	{
+		c = name[k] | name[k + 1] << 8;
+		if (c == 0)
+			break;
+		if (c == ':' || ((c == '/' || c == '\\') && k == 0))
+			return 0;
+		if (c == '/' || c == '\\')
+		{
+			if (len > 1 && dots)
+				return 0;
+			len = 0;
+			dots = 1;
+			continue;
+		}
+		len++;
+		if (c != '.' && c != ' ')
+			dots = 0;
+	}
+	return !(len > 1 && dots);
+}
+
+int ddp_entry_path(const ddp_pchar *dir, unit32 dirlen, const struct ddp_entry *e, unit32 i, int type, ddp_pchar *path)
+{
+	const char *ext = ddp_type_ext(type);
+	unit32 n = dirlen, k, c, room = DDP_PATH_MAX - 16;//留出扩展名的位置
+	if (e->name != NULL && !ddp_safe_name(e->name, e->namelen))
+	{
+		path[0] = 0;
+		return DDP_ERR_NAME;
+	}
+	memcpy(path, dir, n * sizeof(ddp_pchar));
+	if (e->name == NULL)
+	{
+#ifdef _WIN32
+		n += swprintf(path + n, 16, L"%08u", i);
+#else
+		n += sprintf(path + n, "%08u", i);
+#endif
+	}
+	else
+	{
+		for (k = 0; k + 1 < e->namelen && n < room; k += 2)
+		{
+			c = e->name[k] | e->name[k + 1] << 8;
+			if (c == 0)
+				break;
+#ifdef _WIN32
+			path[n++] = (WCHAR)c;
+#else
+			//按UTF-8编码，代理对合成一个码点
+			if (c >= 0xD800 && c < 0xDC00 && k + 3 < e->namelen)
+			{
+				c = 0x10000 + ((c - 0xD800) << 10) + ((e->name[k + 2] | e->name[k + 3] << 8) & 0x3FF);
+				k += 2;
+			}
+			if (c < 0x80)
+				path[n++] = (char)c;
+			else if (c < 0x800)
+			{
+				path[n++] = (char)(0xC0 | c >> 6);
+				path[n++] = (char)(0x80 | (c & 0x3F));
+			}
+			else if (c < 0x10000)
+			{
+				path[n++] = (char)(0xE0 | c >> 12);
+				path[n++] = (char)(0x80 | (c >> 6 & 0x3F));
+				path[n++] = (char)(0x80 | (c & 0x3F));
+			}
+			else
+			{
+				path[n++] = (char)(0xF0 | c >> 18);
+				path[n++] = (char)(0x80 | (c >> 12 & 0x3F));
+				path[n++] = (char)(0x80 | (c >> 6 & 0x3F));
+				path[n++] = (char)(0x80 | (c & 0x3F));
+			}
+#endif
+		}
+	}
+	path[n++] = '.';
+	for (k = 0; ext[k] != 0; k++)
+		path[n++] = ext[k];
+	path[n] = 0;
+	return DDP_OK;
+}
+
+void ddp_make_parents(ddp_pchar *path, unit32 dirlen)
+{
+	ddp_pchar *p, c;
+	for (p = path + dirlen; *p != 0; p++)
+	{
+		if (*p != '/' && *p != '\\')
+			continue;
+		c = *p;
+		*p = 0;
+#ifdef _WIN32
+		_wmkdir(path);
+#else
+		mkdir(path, 0777);
+#endif
+		*p = c;
+	}
+}
+
+FILE *ddp_path_fopen(const ddp_pchar *path, int write)
+{
+#ifdef _WIN32
+	return _wfopen(path, write ? L"wb" : L"rb");
+#else
+	return fopen(path, write ? "wb" : "rb");
+#endif
+}
+
+long long ddp_path_mtime(const ddp_pchar *path, unit32 *size)
+{
+#ifdef _WIN32
+	struct _stat st;
+	if (_wstat(path, &st) != 0)
+		return -1;
+#else
+	struct stat st;
+	if (stat(path, &st) != 0)
+		return -1;
+#endif
+	if (size != NULL)
+		*size = (unit32)st.st_size;
+	return st.st_mtime;
+}
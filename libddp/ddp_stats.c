@@ -0,0 +1,203 @@
+#define _CRT_SECURE_NO_WARNINGS
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#ifndef _WIN32
+#include <time.h>
+#endif
+#include "ddp_internal.h"
+
+static const char *stage_name[DDP_STAGE_COUNT] = { "read", "decode", "create", "write", "hash", "keep", "load", "compress", "output" };
+
+struct ddp_trace_event
+{
+	unit32 stage;
+	unit32 entry;
+	unit32 tid;
+	unsigned long long start;
+	unsigned long long dur;
+};
+
+struct ddp_stats
+{
+	unsigned long long start;//创建时的时间，trace的时间从这里算起
+	unsigned long long stage_time[DDP_STAGE_COUNT];
+	unsigned long long stage_count[DDP_STAGE_COUNT];
+	unsigned long long *latency;//每个条目各阶段耗时之和
+	unit32 entries;
+	unsigned long long bytes_in;
+	unsigned long long bytes_out;
+	unsigned long long types[DDP_TYPE_BIN + 1];
+	unsigned long long compressed;
+	unsigned long long stored;
+	int trace;
+	ddp_mutex lock;//保护events
+	struct ddp_trace_event *events;
+	size_t num_events;
+	size_t max_events;
+};
+
+static unsigned long long ddp_clock(void)
+{
+#ifdef _WIN32
+	static LARGE_INTEGER freq;
+	LARGE_INTEGER count;
+	if (freq.QuadPart == 0)
+		QueryPerformanceFrequency(&freq);
+	QueryPerformanceCounter(&count);
+	return count.QuadPart / freq.QuadPart * 1000000000ull + count.QuadPart % freq.QuadPart * 1000000000ull / freq.QuadPart;
+#else
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (unsigned long long)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+#endif
+}
+
+ddp_stats *ddp_stats_create(unit32 entries, int trace)
+{
+	ddp_stats *s = calloc(1, sizeof(ddp_stats));
+	if (s == NULL)
+		return NULL;
+	s->latency = calloc(entries ? entries : 1, sizeof(unsigned long long));
+	if (s->latency == NULL)
+	{
+		free(s);
+		return NULL;
+	}
+	s->entries = entries;
+	s->trace = trace;
+	ddp_mutex_init(&s->lock);
+	s->start = ddp_clock();
+	return s;
+}
+
+void ddp_stats_free(ddp_stats *s)
+{
+	if (s == NULL)
+		return;
+	ddp_mutex_destroy(&s->lock);
+	free(s->events);
+	free(s->latency);
+	free(s);
+}
+
+unsigned long long ddp_stats_now(ddp_stats *s)
+{
+	return s != NULL ? ddp_clock() : 0;
+}
+
+unsigned long long ddp_stats_stage(ddp_stats *s, int stage, unit32 i, unsigned long long start)
+{
+	unsigned long long now, dur;
+	struct ddp_trace_event *ev;
+	size_t max;
+	if (s == NULL)
+		return 0;
+	now = ddp_clock();
+	dur = now - start;
+	ddp_atomic_add64(&s->stage_time[stage], dur);
+	ddp_atomic_add64(&s->stage_count[stage], 1);
+	if (i < s->entries)
+		ddp_atomic_add64(&s->latency[i], dur);
+	if (s->trace)
+	{
+		ddp_mutex_lock(&s->lock);
+		if (s->num_events == s->max_events)
+		{
+			max = s->max_events ? s->max_events * 2 : 4096;
+			ev = realloc(s->events, max * sizeof(struct ddp_trace_event));
+			if (ev != NULL)
+			{
+				s->events = ev;
+				s->max_events = max;
+			}
+		}
+		//内存不够时丢掉这个事件，统计的数字不受影响
+		if (s->num_events < s->max_events)
+		{
+			ev = &s->events[s->num_events++];
+			ev->stage = stage;
+			ev->entry = i;
+			ev->tid = ddp_thread_id();
+			ev->start = start - s->start;
+			ev->dur = dur;
+		}
+		ddp_mutex_unlock(&s->lock);
+	}
+	return now;
+}
+
+void ddp_stats_entry(ddp_stats *s, int type, unit32 in, unit32 out, int stored)
+{
+	if (s == NULL)
+		return;
+	ddp_atomic_add64(&s->bytes_in, in);
+	ddp_atomic_add64(&s->bytes_out, out);
+	if (type >= 0 && type <= DDP_TYPE_BIN)
+		ddp_atomic_add64(&s->types[type], 1);
+	ddp_atomic_add64(stored ? &s->stored : &s->compressed, 1);
+}
+
+static int ddp_cmp_u64(const void *a, const void *b)
+{
+	unsigned long long x = *(const unsigned long long *)a, y = *(const unsigned long long *)b;
+	return x < y ? -1 : x > y;
+}
+
+void ddp_stats_print(ddp_stats *s, FILE *fp)
+{
+	unsigned long long total = 0, *sorted;
+	unit32 i, n = 0;
+	int k;
+	double wall;
+	if (s == NULL)
+		return;
+	wall = (ddp_clock() - s->start) / 1e9;
+	for (k = 0; k < DDP_STAGE_COUNT; k++)
+		total += s->stage_time[k];
+	fprintf(fp, "统计：总耗时%.3fs 条目%llu(压缩%llu 未压缩%llu) 读入%.1fMB 写出%.1fMB\n", wall, s->compressed + s->stored, s->compressed, s->stored,
+		s->bytes_in / 1048576.0, s->bytes_out / 1048576.0);
+	fprintf(fp, "\t阶段        耗时(s)   占比      次数   平均(us)\n");
+	for (k = 0; k < DDP_STAGE_COUNT; k++)
+		if (s->stage_count[k] != 0)
+			fprintf(fp, "\t%-9s %9.3f %5.1f%% %9llu %10.1f\n", stage_name[k], s->stage_time[k] / 1e9, total ? s->stage_time[k] * 100.0 / total : 0,
+				s->stage_count[k], s->stage_time[k] / 1e3 / s->stage_count[k]);
+	fprintf(fp, "\t类型：");
+	for (k = 0; k <= DDP_TYPE_BIN; k++)
+		fprintf(fp, "%s:%llu ", ddp_type_ext(k), s->types[k]);
+	fprintf(fp, "\n");
+	//多线程时各阶段的耗时之和会超过总耗时
+	sorted = malloc((s->entries ? s->entries : 1) * sizeof(unsigned long long));
+	if (sorted == NULL)
+		return;
+	for (i = 0; i < s->entries; i++)
+		if (s->latency[i] != 0)
+			sorted[n++] = s->latency[i];
+	if (n != 0)
+	{
+		qsort(sorted, n, sizeof(unsigned long long), ddp_cmp_u64);
+		fprintf(fp, "\t每个条目的耗时：p50 %.1fus p99 %.1fus 最大 %.1fus\n", sorted[(n - 1) * 50ull / 100] / 1e3, sorted[(n - 1) * 99ull / 100] / 1e3, sorted[n - 1] / 1e3);
+	}
+	free(sorted);
+}
+
+int ddp_stats_write_trace(ddp_stats *s, const char *path)
+{
+	FILE *fp;
+	size_t i;
+	struct ddp_trace_event *ev;
+	if (s == NULL)
+		return DDP_OK;
+	fp = fopen(path, "w");
+	if (fp == NULL)
+		return DDP_ERR_OPEN;
+	fprintf(fp, "{\"traceEvents\":[");
+	for (i = 0; i < s->num_events; i++)
+	{
+		ev = &s->events[i];
+		fprintf(fp, "%s\n{\"name\":\"%s\",\"cat\":\"ddp\",\"ph\":\"X\",\"pid\":1,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f,\"args\":{\"entry\":%u}}",
+			i ? "," : "", stage_name[ev->stage], ev->tid, ev->start / 1e3, ev->dur / 1e3, ev->entry);
+	}
+	fprintf(fp, "\n],\"displayTimeUnit\":\"ms\"}\n");
+	return fclose(fp) == 0 ? DDP_OK : DDP_ERR_WRITE;
+}
@@ -0,0 +1,38 @@
+#include "ddp_internal.h"
+#ifdef _WIN32
+#include <process.h>
+#else
+#include <unistd.h>
+#include <sys/syscall.h>
+#endif
+
+int ddp_thread_start(ddp_thread *t, ddp_thread_fn fn, void *arg)
+{
+#ifdef _WIN32
+	*t = (HANDLE)_beginthreadex(NULL, 0, fn, arg, 0, NULL);
+	return *t != NULL;
+#else
+	return pthread_create(t, NULL, fn, arg) == 0;
+#endif
+}
+
+void ddp_thread_join(ddp_thread t)
+{
+#ifdef _WIN32
+	WaitForSingleObject(t, INFINITE);
+	CloseHandle(t);
+#else
+	pthread_join(t, NULL);
+#endif
+}
+
+unit32 ddp_thread_id(void)
+{
+#ifdef _WIN32
+	return GetCurrentThreadId();
+#elif defined(SYS_gettid)
+	return (unit32)syscall(SYS_gettid);
+#else
+	return (unit32)(size_t)pthread_self();
+#endif
+}
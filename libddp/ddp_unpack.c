@@ -0,0 +1,294 @@
+#define _CRT_SECURE_NO_WARNINGS
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "ddp_internal.h"
+
+#define DDP_UNPACK_CHUNK 8//工作线程每次领取的条目数
+
+struct ddp_unpack_archive
+{
+	ddp_archive *ar;
+	ddp_pchar dir[DDP_PATH_MAX];//输出目录，末尾带分隔符
+	unit32 dirlen;
+	char manifest[DDP_PATH_MAX];
+	struct ddp_manifest_entry *entries;
+	unit32 base;//第一个条目在所有条目中的序号，用于统计
+	unit32 remaining;//还没解包完的条目数，减到0时写出清单
+	unit32 *first;//共用同一数据区的第一个条目，没有共用数据区的条目时为NULL
+	unit32 *next_shared;//同一数据区的下一个条目，DDP_NOT_FOUND结束
+};
+
+struct ddp_unpack_pool
+{
+	struct ddp_unpack_archive *archives;
+	struct ddp_unpack_result *results;
+	struct ddp_unpack_params *params;
+	unit32 num;
+	unit32 buflen;
+	ddp_mutex lock;
+	unit32 next_archive;//下一个待领取的条目所在的封包和序号
+	unit32 next_entry;
+};
+
+//把第i个条目解压出的数据写出为文件并填写清单记录；src为同一数据区已经写出的条目，沿用它的类型和哈希
+static int ddp_unpack_save(struct ddp_unpack_pool *pool, struct ddp_unpack_archive *ua, unit32 i, const unit8 *udata, const struct ddp_manifest_entry *src)
+{
+	ddp_stats *stats = pool->params->stats;
+	struct ddp_manifest_entry *m = &ua->entries[i];
+	struct ddp_entry e;
+	ddp_pchar path[DDP_PATH_MAX];
+	unit32 si = ua->base + i;
+	FILE *dst;
+	int type, ret;
+	unsigned long long t;
+	ddp_get_entry(ua->ar, i, &e);
+	type = src != NULL ? src->type : ddp_sniff(udata, e.uncomprlen);
+	ret = ddp_entry_path(ua->dir, ua->dirlen, &e, i, type, path);
+	t = ddp_stats_now(stats);
+	dst = ret == DDP_OK ? ddp_path_fopen(path, 1) : NULL;
+	if (dst == NULL && ret == DDP_OK && e.name != NULL)
+	{
+		ddp_make_parents(path, ua->dirlen);
+		dst = ddp_path_fopen(path, 1);
+	}
+	t = ddp_stats_stage(stats, DDP_STAGE_CREATE, si, t);
+	if (dst == NULL && ret == DDP_OK)
+		ret = DDP_ERR_OPEN;
+	else if (dst != NULL)
+	{
+		if (e.uncomprlen != 0 && fwrite(udata, e.uncomprlen, 1, dst) != 1)
+			ret = DDP_ERR_WRITE;
+		if (fclose(dst) != 0)
+			ret = DDP_ERR_WRITE;
+	}
+	t = ddp_stats_stage(stats, DDP_STAGE_WRITE, si, t);
+	m->type = (unit8)type;
+	m->size = e.uncomprlen;
+	m->mtime = ddp_path_mtime(path, NULL);
+	m->hash = src != NULL ? src->hash : ddp_hash64(udata, e.uncomprlen);
+	ddp_stats_stage(stats, DDP_STAGE_HASH, si, t);
+	ddp_stats_entry(stats, type, e.comprlen != 0 ? e.comprlen : e.uncomprlen, e.uncomprlen, e.comprlen == 0);
+	if (pool->params->done != NULL)
+		pool->params->done(pool->params->ctx, (unit32)(ua - pool->archives), i, &e, type, ret);
+	return ret;
+}
+
+//解压第i个条目到buf，写出它和共用同一数据区的所有条目，失败的条目数和解包出的字节数累加到*failed和*bytes
+static void ddp_unpack_entry(struct ddp_unpack_pool *pool, struct ddp_unpack_archive *ua, unit32 i, unit8 *buf, unit32 *failed, unsigned long long *bytes, int *err)
+{
+	ddp_stats *stats = pool->params->stats;
+	struct ddp_entry e;
+	unit8 *udata;
+	unit32 j, si = ua->base + i;
+	int ret;
+	unsigned long long t = ddp_stats_now(stats);
+	if (stats != NULL)
+	{
+		ddp_touch_entry(ua->ar, i);
+		t = ddp_stats_stage(stats, DDP_STAGE_READ, si, t);
+	}
+	udata = ddp_load_into(ua->ar, i, buf, pool->buflen);
+	ddp_stats_stage(stats, DDP_STAGE_DECODE, si, t);
+	for (j = i; j != DDP_NOT_FOUND; j = ua->next_shared != NULL ? ua->next_shared[j] : DDP_NOT_FOUND)
+	{
+		if (udata != NULL)
+			ret = ddp_unpack_save(pool, ua, j, udata, j != i ? &ua->entries[i] : NULL);
+		else
+		{
+			ua->entries[j].type = (unit8)ddp_entry_type(ua->ar, j);
+			ret = DDP_ERR_READ;
+			if (pool->params->done != NULL)
+				pool->params->done(pool->params->ctx, (unit32)(ua - pool->archives), j, ddp_get_entry(ua->ar, j, &e), ua->entries[j].type, ret);
+		}
+		if (ret != DDP_OK)
+		{
+			(*failed)++;
+			if (*err == DDP_OK)
+				*err = ret;
+		}
+		else
+			*bytes += ua->entries[j].size;
+	}
+}
+
+//所有封包的条目排成一列，各线程每次领取DDP_UNPACK_CHUNK个，小封包解完后马上接着解下一个封包
+static DDP_THREAD_FN ddp_unpack_worker(void *arg)
+{
+	struct ddp_unpack_pool *pool = arg;
+	struct ddp_unpack_archive *ua;
+	struct ddp_unpack_result *res;
+	unit8 *buf = ddp_alloc_aligned(pool->buflen ? pool->buflen : 1, 64);
+	unit32 a, i, start, end, failed;
+	unsigned long long bytes;
+	int err, last;
+	for (;;)
+	{
+		ddp_mutex_lock(&pool->lock);
+		while (pool->next_archive < pool->num && (pool->archives[pool->next_archive].ar == NULL || pool->next_entry >= ddp_entry_count(pool->archives[pool->next_archive].ar)))
+		{
+			pool->next_archive++;
+			pool->next_entry = 0;
+		}
+		if (pool->next_archive >= pool->num || buf == NULL || (pool->params->cancel != NULL && *pool->params->cancel))
+		{
+			ddp_mutex_unlock(&pool->lock);
+			break;
+		}
+		a = pool->next_archive;
+		ua = &pool->archives[a];
+		start = pool->next_entry;
+		end = ddp_entry_count(ua->ar) - start > DDP_UNPACK_CHUNK ? start + DDP_UNPACK_CHUNK : ddp_entry_count(ua->ar);
+		pool->next_entry = end;
+		ddp_mutex_unlock(&pool->lock);
+		failed = 0;
+		bytes = 0;
+		err = DDP_OK;
+		//共用数据区的条目在解压第一个条目时一起写出
+		for (i = start; i < end; i++)
+			if (ua->first == NULL || ua->first[i] == i)
+				ddp_unpack_entry(pool, ua, i, buf, &failed, &bytes, &err);
+		ddp_mutex_lock(&pool->lock);
+		res = &pool->results[a];
+		res->failed += failed;
+		res->bytes += bytes;
+		if (res->err == DDP_OK)
+			res->err = err;
+		ua->remaining -= end - start;
+		last = ua->remaining == 0;
+		ddp_mutex_unlock(&pool->lock);
+		//最后一个块解完的线程写出清单
+		if (last && ddp_manifest_write(ua->manifest, ua->ar, ua->entries) != DDP_OK)
+			res->manifest_err = 1;
+	}
+	if (buf != NULL)
+		ddp_free_aligned(buf);
+	return 0;
+}
+
+//按偏移和长度找出共用同一数据区的条目(打包时去重的结果)，每个数据区只解压一次
+//散列表的大小为不小于条目数2倍的2的幂，按偏移取乘法散列的高位，线性探测；没有共用数据区时不保留任何东西
+static int ddp_unpack_find_shared(struct ddp_unpack_archive *ua, unit32 *shared)
+{
+	ddp_archive *ar = ua->ar;
+	unit32 *table, size = 1, shift = 32, k, i, j;
+	while (size < ar->count * 2)
+	{
+		size <<= 1;
+		shift--;
+	}
+	table = malloc(size * sizeof(unit32));
+	if (table == NULL)
+		return DDP_ERR_NOMEM;
+	memset(table, 0xFF, size * sizeof(unit32));
+	for (i = 0; i < ar->count; i++)
+	{
+		for (k = (ar->offset[i] * 0x9E3779B1u) >> shift; (j = table[k]) != DDP_NOT_FOUND; k = (k + 1) & (size - 1))
+			if (ar->offset[j] == ar->offset[i] && ar->comprlen[j] == ar->comprlen[i] && ar->uncomprlen[j] == ar->uncomprlen[i])
+				break;
+		if (j == DDP_NOT_FOUND)
+		{
+			table[k] = i;
+			continue;
+		}
+		if (ua->first == NULL)
+		{
+			ua->first = malloc(ar->count * 2 * sizeof(unit32));
+			if (ua->first == NULL)
+			{
+				free(table);
+				return DDP_ERR_NOMEM;
+			}
+			ua->next_shared = ua->first + ar->count;
+			for (k = 0; k < ar->count; k++)
+			{
+				ua->first[k] = k;
+				ua->next_shared[k] = DDP_NOT_FOUND;
+			}
+		}
+		//表中总是数据区的第一个条目，后面的条目接在它后面
+		ua->first[i] = j;
+		ua->next_shared[i] = ua->next_shared[j];
+		ua->next_shared[j] = i;
+		(*shared)++;
+	}
+	free(table);
+	return DDP_OK;
+}
+
+//建立输出目录，记下目录和清单的路径
+static int ddp_unpack_prepare(struct ddp_unpack_archive *ua, const char *fname, const char *outdir, unit32 *shared)
+{
+	ua->dirlen = ddp_dir_path(fname, outdir, 1, ua->dir, ua->manifest);
+	if (ua->dirlen == 0)
+		return DDP_ERR_OPEN;
+	ua->entries = calloc(ddp_entry_count(ua->ar) ? ddp_entry_count(ua->ar) : 1, sizeof(struct ddp_manifest_entry));
+	if (ua->entries == NULL)
+		return DDP_ERR_NOMEM;
+	return ddp_unpack_find_shared(ua, shared);
+}
+
+int ddp_unpack_archives(ddp_archive **ars, const char **fnames, unit32 num, struct ddp_unpack_params *params, struct ddp_unpack_result *results)
+{
+	struct ddp_unpack_pool pool;
+	ddp_thread *threads = NULL;
+	unit32 a, i, nthreads = 0, maxlen, maxclen, base = 0;
+	int ret = DDP_OK;
+	memset(&pool, 0, sizeof(pool));
+	memset(results, 0, num * sizeof(struct ddp_unpack_result));
+	pool.archives = calloc(num ? num : 1, sizeof(struct ddp_unpack_archive));
+	if (pool.archives == NULL)
+		return DDP_ERR_NOMEM;
+	pool.results = results;
+	pool.params = params;
+	pool.num = num;
+	//每个线程一个缓冲，按所有封包中最大的条目分配
+	for (a = 0; a < num; a++)
+	{
+		if (ars[a] == NULL)
+		{
+			results[a].err = DDP_ERR_OPEN;
+			continue;
+		}
+		pool.archives[a].ar = ars[a];
+		results[a].count = ddp_entry_count(ars[a]);
+		results[a].err = ddp_unpack_prepare(&pool.archives[a], fnames[a], params->outdirs != NULL ? params->outdirs[a] : NULL, &results[a].shared);
+		if (results[a].err != DDP_OK)
+		{
+			pool.archives[a].ar = NULL;
+			continue;
+		}
+		pool.archives[a].base = base;
+		pool.archives[a].remaining = results[a].count;
+		base += results[a].count;
+		ddp_max_lengths(ars[a], &maxlen, &maxclen);
+		if ((unsigned long long)maxlen + maxclen > pool.buflen)
+			pool.buflen = maxlen + maxclen < maxlen ? 0xFFFFFFFF : maxlen + maxclen;
+		//没有条目的封包在这里直接写出空清单
+		if (results[a].count == 0 && ddp_manifest_write(pool.archives[a].manifest, ars[a], pool.archives[a].entries) != DDP_OK)
+			results[a].manifest_err = 1;
+	}
+	ddp_mutex_init(&pool.lock);
+	if (params->threads > 1)
+		threads = malloc(params->threads * sizeof(ddp_thread));
+	for (i = 1; threads != NULL && i < params->threads; i++)
+		if (ddp_thread_start(&threads[nthreads], ddp_unpack_worker, &pool))
+			nthreads++;
+	ddp_unpack_worker(&pool);
+	for (i = 0; i < nthreads; i++)
+		ddp_thread_join(threads[i]);
+	free(threads);
+	ddp_mutex_destroy(&pool.lock);
+	for (a = 0; a < num; a++)
+	{
+		//取消或者缓冲分配失败时条目没有解完
+		if (pool.archives[a].ar != NULL && pool.archives[a].remaining != 0)
+			results[a].err = params->cancel != NULL && *params->cancel ? DDP_ERR_CANCELLED : DDP_ERR_NOMEM;
+		if (results[a].err != DDP_OK || results[a].manifest_err)
+			ret = results[a].err != DDP_OK ? results[a].err : DDP_ERR_WRITE;
+		free(pool.archives[a].entries);
+		free(pool.archives[a].first);
+	}
+	free(pool.archives);
+	return ret;
+}
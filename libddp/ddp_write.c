@@ -0,0 +1,941 @@
+#define _CRT_SECURE_NO_WARNINGS
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#ifdef _WIN32
+#include <Windows.h>
+#else
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#endif
+#include "ddp_internal.h"
+
+#define DDP_WRITE_BUF    (1 << 20)//写缓冲大小
+#define DDP_WRITE_ALIGN  4096
+#define DDP_WRITE_BUDGET (64 << 20)//多线程压缩时默认的内存预算
+#define DDP_BLOCK        (256 << 10)//大于它的条目按块独立压缩
+#define DDP_BLOCK_ROOM   (DDP_BLOCK + 5)//每块的输出空间，压缩不了时存为字面量要多5字节的token头
+#define DDP_BLOCKLEN_POS(blocks) (((blocks) * DDP_BLOCK_ROOM + 3) & ~3u)//分块压缩时各块的长度放在缓冲的最后
+#define DDP_COMPARE_BUF  (64 << 10)//去重时从输出文件读回比较的缓冲
+
+struct ddp_writer
+{
+	unit8 *buf;
+	unit32 used;
+	ddp_sink_fn sink;//为NULL时写文件
+	void *ctx;
+#ifdef _WIN32
+	HANDLE file;
+#else
+	int fd;
+#endif
+	int err;
+};
+
+static int ddp_write_raw(struct ddp_writer *w, const unit8 *data, unit32 len)
+{
+#ifdef _WIN32
+	DWORD done;
+#else
+	ssize_t done;
+#endif
+	if (w->sink != NULL)
+		return w->sink(w->ctx, data, len);
+	while (len != 0)
+	{
+#ifdef _WIN32
+		if (!WriteFile(w->file, data, len, &done, NULL) || done == 0)
+			return 0;
+#else
+		done = write(w->fd, data, len);
+		if (done < 0 && errno == EINTR)
+			continue;
+		if (done <= 0)
+			return 0;
+#endif
+		data += done;
+		len -= (unit32)done;
+	}
+	return 1;
+}
+
+static void ddp_flush(struct ddp_writer *w)
+{
+	if (w->used != 0 && w->err == DDP_OK && !ddp_write_raw(w, w->buf, w->used))
+		w->err = DDP_ERR_WRITE;
+	w->used = 0;
+}
+
+//数据先攒进写缓冲，缓冲满了再整块写出；缓冲为空时大块数据直接写出，不再复制
+static void ddp_put(struct ddp_writer *w, const unit8 *data, unit32 len)
+{
+	unit32 n;
+	while (len != 0 && w->err == DDP_OK)
+	{
+		if (w->used == 0 && len >= DDP_WRITE_BUF)
+		{
+			if (!ddp_write_raw(w, data, len))
+				w->err = DDP_ERR_WRITE;
+			return;
+		}
+		n = DDP_WRITE_BUF - w->used < len ? DDP_WRITE_BUF - w->used : len;
+		memcpy(w->buf + w->used, data, n);
+		w->used += n;
+		data += n;
+		len -= n;
+		if (w->used == DDP_WRITE_BUF)
+			ddp_flush(w);
+	}
+}
+
+//在文件的指定位置写入，不移动顺序写的位置
+static int ddp_pwrite(struct ddp_writer *w, const unit8 *data, unit32 len, unit32 offset)
+{
+#ifdef _WIN32
+	OVERLAPPED ov;
+	DWORD done;
+	memset(&ov, 0, sizeof(ov));
+	ov.Offset = offset;
+	return WriteFile(w->file, data, len, &done, &ov) && done == len;
+#else
+	return pwrite(w->fd, data, len, offset) == (ssize_t)len;
+#endif
+}
+
+//从输出文件读回已写出的数据。Windows下同步句柄的带偏移读取会移动文件指针，读完后移回文件末尾继续顺序写
+static int ddp_pread_out(struct ddp_writer *w, unit8 *data, unit32 len, unit32 offset)
+{
+#ifdef _WIN32
+	OVERLAPPED ov;
+	DWORD done;
+	int ok;
+	memset(&ov, 0, sizeof(ov));
+	ov.Offset = offset;
+	ok = ReadFile(w->file, data, len, &done, &ov) && done == len;
+	SetFilePointer(w->file, 0, NULL, FILE_END);
+	return ok;
+#else
+	return pread(w->fd, data, len, offset) == (ssize_t)len;
+#endif
+}
+
+//已写出的一块数据区
+struct ddp_region
+{
+	unsigned long long hash;
+	unit32 offset;
+	unit32 size;
+	unit32 uncomprlen;
+	unit32 comprlen;
+};
+
+//写出时去重：按存储的数据(压缩后)的哈希查找前面写出过的相同数据区，哈希相同时再逐字节确认
+struct ddp_dedup
+{
+	unit32 mask;
+	unit32 *table;//regions的序号，线性探测，空位为DDP_NOT_FOUND
+	struct ddp_region *regions;
+	unit32 count;
+	unit8 *tmp;//DDP_COMPARE_BUF字节
+};
+
+static int ddp_dedup_init(struct ddp_dedup *d, unit32 count)
+{
+	unit32 size = 1;
+	while (size < count * 2)
+		size <<= 1;
+	d->mask = size - 1;
+	d->count = 0;
+	d->table = malloc(size * sizeof(unit32));
+	d->regions = malloc((count ? count : 1) * sizeof(struct ddp_region));
+	d->tmp = malloc(DDP_COMPARE_BUF);
+	if (d->table == NULL || d->regions == NULL || d->tmp == NULL)
+		return 0;
+	memset(d->table, 0xFF, size * sizeof(unit32));
+	return 1;
+}
+
+static void ddp_dedup_free(struct ddp_dedup *d)
+{
+	free(d->table);
+	free(d->regions);
+	free(d->tmp);
+}
+
+//比较已写出的[offset, offset + size)与data：暂存在内存或写缓冲中的直接比较，已写到文件的分段读回比较
+//pos为下一个要写出的位置，spool从base开始
+static int ddp_same_written(struct ddp_dedup *d, struct ddp_writer *w, int seekable, const unit8 *spool, unit32 base, unit32 pos,
+	unit32 offset, const unit8 *data, unit32 size)
+{
+	unit32 start = pos - w->used, n;//写缓冲中第一个字节的位置
+	if (!seekable)
+		return memcmp(spool + offset - base, data, size) == 0;
+	while (size != 0 && offset < start)
+	{
+		n = start - offset < DDP_COMPARE_BUF ? start - offset : DDP_COMPARE_BUF;
+		n = n < size ? n : size;
+		if (!ddp_pread_out(w, d->tmp, n, offset) || memcmp(d->tmp, data, n) != 0)
+			return 0;
+		offset += n;
+		data += n;
+		size -= n;
+	}
+	return size == 0 || memcmp(w->buf + offset - start, data, size) == 0;
+}
+
+//e的数据out与前面写出过的数据区相同时把e->offset指向那里并返回1，否则把它登记为新的数据区(将写在pos)
+static int ddp_dedup_find(struct ddp_dedup *d, struct ddp_writer *w, int seekable, const unit8 *spool, unit32 base, unit32 pos,
+	struct ddp_entry *e, const unit8 *out, unit32 size)
+{
+	unsigned long long hash = ddp_hash64(out, size);
+	struct ddp_region *r;
+	unit32 k;
+	for (k = (unit32)hash & d->mask; d->table[k] != DDP_NOT_FOUND; k = (k + 1) & d->mask)
+	{
+		r = &d->regions[d->table[k]];
+		if (r->hash == hash && r->size == size && r->uncomprlen == e->uncomprlen && r->comprlen == e->comprlen
+			&& ddp_same_written(d, w, seekable, spool, base, pos, r->offset, out, size))
+		{
+			e->offset = r->offset;
+			return 1;
+		}
+	}
+	r = &d->regions[d->count];
+	r->hash = hash;
+	r->offset = pos;
+	r->size = size;
+	r->uncomprlen = e->uncomprlen;
+	r->comprlen = e->comprlen;
+	d->table[k] = d->count++;
+	return 0;
+}
+
+static void ddp_patch_record(ddp_archive *ar, unit8 *head, const struct ddp_entry *e)
+{
+	unit32 field = ar->format == DDP_FORMAT_DDP3 ? 1 : 0;//DDP3记录开头有1字节长度
+	memcpy(head + e->record + field, &e->offset, 4);
+	memcpy(head + e->record + field + 4, &e->uncomprlen, 4);
+	memcpy(head + e->record + field + 8, &e->comprlen, 4);
+}
+
+//第i个条目沿用原封包中存储的数据，只更新偏移；映射时*out直接指向映射的内存，否则读到*cdata
+static int ddp_keep_entry(ddp_archive *ar, ddp_bufpool *bufs, unit8 *head, unit32 i, unit32 pos, struct ddp_entry *e, unit8 **cdata, unit8 **out)
+{
+	unit32 len;
+	ddp_get_entry(ar, i, e);
+	len = e->comprlen != 0 ? e->comprlen : e->uncomprlen;
+	*cdata = NULL;
+	if (e->offset > ar->size || len > ar->size - e->offset)
+		return DDP_ERR_READ;
+	if (ar->map != NULL)
+		*out = ar->map + e->offset;
+	else
+	{
+		*out = *cdata = ddp_bufpool_get(bufs, len);
+		if (*cdata == NULL)
+			return DDP_ERR_NOMEM;
+		if (ddp_read_raw(ar, i, *cdata, len) != DDP_OK)
+			return DDP_ERR_READ;
+	}
+	e->offset = pos;
+	ddp_patch_record(ar, head, e);
+	return DDP_OK;
+}
+
+static unit32 ddp_block_count(unit32 len, int level)
+{
+	return len > DDP_BLOCK && level != DDP_LEVEL_STORE ? (len + DDP_BLOCK - 1) / DDP_BLOCK : 1;
+}
+
+//压缩数据的缓冲大小，分块时每块独占DDP_BLOCK_ROOM字节，各块可以同时压缩
+static unit32 ddp_cdata_size(unit32 len, int level)
+{
+	unit32 blocks = ddp_block_count(len, level);
+	return blocks > 1 ? DDP_BLOCKLEN_POS(blocks) + blocks * sizeof(unit32) : len ? len : 1;
+}
+
+//第b块单独压缩到dst，不引用前面块的数据；压缩不了时整块存为一个字面量token
+static unit32 ddp_compress_block(struct ddp_cctx *cctx, unit8 *dst, unit8 *data, unit32 len, unit32 b, int level)
+{
+	unit32 start = b * DDP_BLOCK, n = len - start < DDP_BLOCK ? len - start : DDP_BLOCK, clen;
+	clen = ddp_compress_with(cctx, dst, n, data + start, n, level);
+	return clen != 0 ? clen : ddp_store_literals(dst, data + start, n);
+}
+
+//压缩整个条目，返回comprlen，0表示按原样存储
+//大的条目总是按块压缩，无论用几个线程，同样的输入得到同样的输出
+static unit32 ddp_compress_entry(struct ddp_cctx *cctx, unit8 *cdata, unit8 *data, unit32 len, int level)
+{
+	unit32 blocks = ddp_block_count(len, level), b, clen = 0;
+	if (cdata == NULL)
+		return 0;
+	if (blocks == 1)
+		clen = ddp_compress_with(cctx, cdata, len, data, len, level);
+	else
+		for (b = 0; b < blocks; b++)
+			clen += ddp_compress_block(cctx, cdata + clen, data, len, b, level);
+	return clen < len ? clen : 0;
+}
+
+//把load返回的缓冲交给done；done为NULL时按release的约定释放
+static void ddp_entry_done(struct ddp_write_params *params, unit32 i, unit8 *data, const struct ddp_entry *e)
+{
+	if (params->done != NULL)
+		params->done(params->ctx, i, data, e);
+	else if (data != NULL && params->release != NULL)
+		params->release(params->ctx, data);
+	else
+		free(data);
+}
+
+//取得第i个条目的新内容并压缩，更新head中的索引记录
+//*out为要写出的数据，指向*data或*cdata；调用者写出后调用done并把*cdata还给bufs
+static int ddp_pack_entry(ddp_archive *ar, struct ddp_write_params *params, ddp_bufpool *bufs, struct ddp_cctx *cctx, unit8 *head, unit32 i, unit32 pos,
+	struct ddp_entry *e, unit8 **data, unit8 **cdata, unit8 **out)
+{
+	unit32 len;
+	unsigned long long t = ddp_stats_now(params->stats);
+	ddp_get_entry(ar, i, e);
+	*cdata = NULL;
+	*data = params->load(params->ctx, ar, i, &len);
+	t = ddp_stats_stage(params->stats, DDP_STAGE_LOAD, i, t);
+	if (*data == NULL)
+		return DDP_ERR_READ;
+	e->offset = pos;
+	e->uncomprlen = len;
+	*cdata = ddp_bufpool_get(bufs, ddp_cdata_size(len, params->level));
+	e->comprlen = ddp_compress_entry(cctx, *cdata, *data, len, params->level);
+	ddp_stats_stage(params->stats, DDP_STAGE_COMPRESS, i, t);
+	*out = e->comprlen != 0 ? *cdata : *data;
+	ddp_patch_record(ar, head, e);
+	return DDP_OK;
+}
+
+enum
+{
+	DDP_JOB_PENDING = 0,
+	DDP_JOB_KEEP,//沿用原数据
+	DDP_JOB_DONE//压缩完成或者失败
+};
+
+//一个条目的压缩任务，写出前一直占着预算
+struct ddp_job
+{
+	int state;
+	int ret;
+	unit8 *data;
+	unit8 *cdata;
+	unit32 len;
+	unit32 comprlen;
+	unit32 cost;//计入内存预算的字节数
+	unit32 expect;//预先确定大小时load应返回的长度
+	int checked;//预先确定大小时已经调用过keep并返回0
+	unit32 blocks;//分块压缩的块数
+	unit32 next_block;//下一个待领取的块
+	unit32 done_blocks;
+	unit32 *blocklen;//在cdata的最后
+	struct ddp_job *next_split;
+};
+
+//多线程压缩：工作线程按存放的顺序领取条目，写出线程按同样的顺序等待并写出，偏移按写出的顺序分配
+//已领取未写出的条目占用的内存不超过预算，超出时工作线程等待写出线程释放
+struct ddp_pool
+{
+	ddp_archive *ar;
+	struct ddp_write_params *params;
+	struct ddp_job *jobs;
+	ddp_bufpool *bufs;//压缩数据的缓冲，写出后归还给下一个条目使用
+	ddp_mutex lock;
+	ddp_cond cond;
+	const unit32 *order;//存放的顺序，为NULL时按序号
+	unit32 next;//下一个待领取的条目在存放顺序中的位置
+	unit32 active;//正在读入的条目数，读完后可能变成分块任务
+	unsigned long long inflight;
+	unsigned long long budget;
+	struct ddp_job *split;//还有块没领走的条目，按序号排队
+	struct ddp_job *split_tail;
+	int stop;
+};
+
+//读入第i个条目，不分块的直接压缩；返回DDP_JOB_PENDING时还要分块压缩
+static int ddp_prepare_job(ddp_archive *ar, struct ddp_write_params *params, ddp_bufpool *bufs, struct ddp_cctx *cctx, unit32 i, struct ddp_job *job)
+{
+	unit32 size;
+	unsigned long long t = ddp_stats_now(params->stats);
+	int keep;
+	if (job->state == DDP_JOB_KEEP)
+		return DDP_JOB_KEEP;//预先确定大小时已经判断过
+	if (params->keep != NULL && !job->checked)
+	{
+		keep = params->keep(params->ctx, ar, i);
+		t = ddp_stats_stage(params->stats, DDP_STAGE_KEEP, i, t);
+		if (keep)
+			return DDP_JOB_KEEP;
+	}
+	job->data = params->load(params->ctx, ar, i, &job->len);
+	t = ddp_stats_stage(params->stats, DDP_STAGE_LOAD, i, t);
+	if (job->data == NULL)
+	{
+		job->ret = DDP_ERR_READ;
+		return DDP_JOB_DONE;
+	}
+	size = ddp_cdata_size(job->len, params->level);
+	job->cdata = ddp_bufpool_get(bufs, size);
+	job->cost = job->len + size;
+	job->blocks = ddp_block_count(job->len, params->level);
+	if (job->blocks > 1 && job->cdata != NULL)
+		job->blocklen = (unit32 *)(job->cdata + DDP_BLOCKLEN_POS(job->blocks));
+	else
+	{
+		job->comprlen = ddp_compress_entry(cctx, job->cdata, job->data, job->len, params->level);
+		ddp_stats_stage(params->stats, DDP_STAGE_COMPRESS, i, t);
+		return DDP_JOB_DONE;
+	}
+	return DDP_JOB_PENDING;
+}
+
+//各块都压缩完后按顺序接起来
+static void ddp_join_blocks(struct ddp_job *job)
+{
+	unit32 b;
+	job->comprlen = 0;
+	for (b = 0; b < job->blocks; b++)
+	{
+		memmove(job->cdata + job->comprlen, job->cdata + b * DDP_BLOCK_ROOM, job->blocklen[b]);
+		job->comprlen += job->blocklen[b];
+	}
+	if (job->comprlen >= job->len)
+		job->comprlen = 0;
+}
+
+static DDP_THREAD_FN ddp_pack_worker(void *arg)
+{
+	struct ddp_pool *pool = arg;
+	struct ddp_job *job;
+	struct ddp_cctx *cctx = ddp_cctx_create();//失败时ddp_compress_with退回每次分配
+	unit32 i, b, est;
+	unsigned long long t;
+	int state;
+	ddp_mutex_lock(&pool->lock);
+	while (!pool->stop)
+	{
+		if (pool->split != NULL)
+		{
+			job = pool->split;
+			b = job->next_block++;
+			if (job->next_block == job->blocks)
+				pool->split = job->next_split;
+			ddp_mutex_unlock(&pool->lock);
+			t = ddp_stats_now(pool->params->stats);
+			job->blocklen[b] = ddp_compress_block(cctx, job->cdata + b * DDP_BLOCK_ROOM, job->data, job->len, b, pool->params->level);
+			ddp_stats_stage(pool->params->stats, DDP_STAGE_COMPRESS, (unit32)(job - pool->jobs), t);
+			ddp_mutex_lock(&pool->lock);
+			if (++job->done_blocks == job->blocks)
+			{
+				ddp_mutex_unlock(&pool->lock);
+				ddp_join_blocks(job);
+				ddp_mutex_lock(&pool->lock);
+				job->state = DDP_JOB_DONE;
+				ddp_cond_broadcast(&pool->cond);
+			}
+			continue;
+		}
+		if (pool->next >= pool->ar->count)
+		{
+			if (pool->active == 0)
+				break;
+			ddp_cond_wait(&pool->cond, &pool->lock);
+			continue;
+		}
+		//按原条目的大小预估，读入后再按实际大小修正；预算已空时总是放行，保证写出线程等的条目能领到
+		i = pool->order != NULL ? pool->order[pool->next] : pool->next;
+		est = pool->ar->uncomprlen[i] * 2;
+		if (pool->inflight != 0 && pool->inflight + est > pool->budget)
+		{
+			ddp_cond_wait(&pool->cond, &pool->lock);
+			continue;
+		}
+		pool->next++;
+		pool->active++;
+		pool->inflight += est;
+		job = &pool->jobs[i];
+		ddp_mutex_unlock(&pool->lock);
+		state = ddp_prepare_job(pool->ar, pool->params, pool->bufs, cctx, i, job);
+		ddp_mutex_lock(&pool->lock);
+		pool->active--;
+		pool->inflight = pool->inflight - est + job->cost;
+		if (state == DDP_JOB_PENDING)
+		{
+			job->next_split = NULL;
+			if (pool->split == NULL)
+				pool->split = job;
+			else
+				pool->split_tail->next_split = job;
+			pool->split_tail = job;
+		}
+		else
+			job->state = state;
+		ddp_cond_broadcast(&pool->cond);
+	}
+	ddp_mutex_unlock(&pool->lock);
+	ddp_cctx_free(cctx);
+	return 0;
+}
+
+//输出不能回写时，不去重且每个条目的大小都能在读入前确定(沿用原数据，或者不压缩且params->size给出了长度)，就先把索引表填好
+//keep在这里按存放的顺序调用，结果记在jobs中，之后不再调用；返回0时只能把条目暂存在内存里，最后再写出索引表
+static int ddp_presize(ddp_archive *ar, struct ddp_write_params *params, struct ddp_job *jobs, unit8 *head)
+{
+	struct ddp_entry e;
+	unit32 i, k, len, pos = ar->header.file_offset;
+	unsigned long long t;
+	if (params->dedup || (params->keep == NULL && (params->level != DDP_LEVEL_STORE || params->size == NULL)))
+		return 0;
+	for (k = 0; k < ar->count; k++)
+	{
+		i = params->order != NULL ? params->order[k] : k;
+		ddp_get_entry(ar, i, &e);
+		if (params->keep != NULL)
+		{
+			t = ddp_stats_now(params->stats);
+			if (params->keep(params->ctx, ar, i))
+				jobs[i].state = DDP_JOB_KEEP;
+			else
+				jobs[i].checked = 1;
+			ddp_stats_stage(params->stats, DDP_STAGE_KEEP, i, t);
+		}
+		if (jobs[i].state != DDP_JOB_KEEP)
+		{
+			if (params->level != DDP_LEVEL_STORE || params->size == NULL || (len = params->size(params->ctx, ar, i)) == DDP_NOT_FOUND)
+				return 0;
+			e.uncomprlen = jobs[i].expect = len;
+			e.comprlen = 0;
+		}
+		len = e.comprlen != 0 ? e.comprlen : e.uncomprlen;
+		if ((unsigned long long)pos + len + 4 > 0xFFFFFFFF)
+			return 0;
+		e.offset = pos;
+		ddp_patch_record(ar, head, &e);
+		pos += len;
+	}
+	return 1;
+}
+
+//seekable为1时先写出原索引表占位，条目顺序写出后在开头一次写回
+//否则能预先确定大小时先写出索引表，条目边处理边写出；不能时先把条目暂存在内存里
+static int ddp_write(ddp_archive *ar, struct ddp_writer *w, int seekable, struct ddp_write_params *params)
+{
+	unit8 *head, *cdata, *out, *spool = NULL, *p;
+	struct ddp_entry e;
+	struct ddp_pool pool;
+	struct ddp_job *job;
+	struct ddp_dedup dedup;
+	struct ddp_cctx *cctx = NULL;
+	ddp_thread *threads = NULL;
+	unit32 i, k, size, need, pos = ar->header.file_offset, spool_size = 0, nthreads = 0;
+	unsigned long long t;
+	int ret = DDP_OK, presized = 0;
+	head = malloc(ar->header.file_offset);
+	w->buf = ddp_alloc_aligned(DDP_WRITE_BUF, DDP_WRITE_ALIGN);
+	w->used = 0;
+	w->err = DDP_OK;
+	memset(&pool, 0, sizeof(pool));
+	memset(&dedup, 0, sizeof(dedup));
+	params->saved = 0;
+	pool.jobs = calloc(ar->count ? ar->count : 1, sizeof(struct ddp_job));
+	ddp_max_lengths(ar, &size, &need);
+	pool.bufs = ddp_bufpool_create(ddp_cdata_size(size, params->level));
+	if (head == NULL || w->buf == NULL || pool.jobs == NULL || pool.bufs == NULL || (params->dedup && !ddp_dedup_init(&dedup, ar->count)))
+	{
+		free(head);
+		free(pool.jobs);
+		ddp_dedup_free(&dedup);
+		ddp_bufpool_free(pool.bufs);
+		if (w->buf != NULL)
+			ddp_free_aligned(w->buf);
+		return DDP_ERR_NOMEM;
+	}
+	memcpy(head, ar->head, ar->header.file_offset);
+	if (!seekable)
+		presized = ddp_presize(ar, params, pool.jobs, head);
+	if (seekable || presized)
+		ddp_put(w, head, ar->header.file_offset);
+	pool.ar = ar;
+	pool.params = params;
+	pool.order = params->order;
+	pool.budget = params->budget != 0 ? params->budget : DDP_WRITE_BUDGET;
+	ddp_mutex_init(&pool.lock);
+	ddp_cond_init(&pool.cond);
+	if (params->threads > 1 && ar->count > 1)
+		threads = malloc(params->threads * sizeof(ddp_thread));
+	for (i = 0; threads != NULL && i < params->threads; i++)
+		if (ddp_thread_start(&threads[nthreads], ddp_pack_worker, &pool))
+			nthreads++;
+	if (nthreads == 0)
+		cctx = ddp_cctx_create();
+	for (k = 0; k < ar->count && ret == DDP_OK; k++)
+	{
+		i = params->order != NULL ? params->order[k] : k;
+		job = &pool.jobs[i];
+		if (nthreads == 0)
+		{
+			job->state = ddp_prepare_job(ar, params, pool.bufs, cctx, i, job);
+			if (job->state == DDP_JOB_PENDING)
+			{
+				t = ddp_stats_now(params->stats);
+				job->comprlen = ddp_compress_entry(cctx, job->cdata, job->data, job->len, params->level);
+				ddp_stats_stage(params->stats, DDP_STAGE_COMPRESS, i, t);
+				job->state = DDP_JOB_DONE;
+			}
+		}
+		else
+		{
+			ddp_mutex_lock(&pool.lock);
+			while (job->state == DDP_JOB_PENDING)
+				ddp_cond_wait(&pool.cond, &pool.lock);
+			ddp_mutex_unlock(&pool.lock);
+		}
+		cdata = NULL;
+		if (job->ret != DDP_OK)
+			ret = job->ret;
+		else if (job->state == DDP_JOB_KEEP)
+			ret = ddp_keep_entry(ar, pool.bufs, head, i, pos, &e, &cdata, &out);
+		else
+		{
+			ddp_get_entry(ar, i, &e);
+			e.offset = pos;
+			e.uncomprlen = job->len;
+			e.comprlen = job->comprlen;
+			out = e.comprlen != 0 ? job->cdata : job->data;
+			ddp_patch_record(ar, head, &e);
+			if (presized && e.uncomprlen != job->expect)
+				ret = DDP_ERR_READ;//读入的内容与预先给出的长度不同，索引表已经写出了
+		}
+		if (ret != DDP_OK)
+		{
+			ddp_bufpool_put(pool.bufs, cdata);
+			break;
+		}
+		size = e.comprlen != 0 ? e.comprlen : e.uncomprlen;
+		t = ddp_stats_now(params->stats);
+		if (params->dedup && size != 0 && ddp_dedup_find(&dedup, w, seekable, spool, ar->header.file_offset, pos, &e, out, size))
+		{
+			ddp_patch_record(ar, head, &e);
+			params->saved += size;
+			size = 0;//共用前面的数据区，不再写出
+		}
+		if (seekable || presized)
+			ddp_put(w, out, size);
+		else if (size != 0)
+		{
+			need = pos - ar->header.file_offset + size;
+			if (need > spool_size)
+			{
+				spool_size = spool_size < need / 2 ? need : spool_size * 2;
+				p = realloc(spool, spool_size);
+				if (p == NULL)
+					ret = DDP_ERR_NOMEM;
+				else
+					spool = p;
+			}
+			if (ret == DDP_OK)
+				memcpy(spool + pos - ar->header.file_offset, out, size);
+		}
+		ddp_stats_stage(params->stats, DDP_STAGE_OUTPUT, i, t);
+		ddp_bufpool_put(pool.bufs, cdata);
+		ddp_bufpool_put(pool.bufs, job->cdata);
+		pos += size;
+		ddp_entry_done(params, i, job->state == DDP_JOB_KEEP ? NULL : job->data, &e);
+		job->data = NULL;
+		job->cdata = NULL;
+		job->blocklen = NULL;
+		ddp_mutex_lock(&pool.lock);
+		pool.inflight -= job->cost;
+		ddp_cond_broadcast(&pool.cond);
+		ddp_mutex_unlock(&pool.lock);
+		if (w->err != DDP_OK)
+			ret = w->err;
+	}
+	//出错时让工作线程停下，还没写出的条目由这里释放
+	ddp_mutex_lock(&pool.lock);
+	pool.stop = 1;
+	ddp_cond_broadcast(&pool.cond);
+	ddp_mutex_unlock(&pool.lock);
+	for (i = 0; i < nthreads; i++)
+		ddp_thread_join(threads[i]);
+	free(threads);
+	for (i = 0; i < ar->count; i++)
+	{
+		if (pool.jobs[i].data != NULL && params->release != NULL)
+			params->release(params->ctx, pool.jobs[i].data);
+		else
+			free(pool.jobs[i].data);
+		ddp_bufpool_put(pool.bufs, pool.jobs[i].cdata);
+	}
+	free(pool.jobs);
+	ddp_dedup_free(&dedup);
+	ddp_bufpool_free(pool.bufs);
+	ddp_cctx_free(cctx);
+	ddp_cond_destroy(&pool.cond);
+	ddp_mutex_destroy(&pool.lock);
+	if (ret == DDP_OK)
+	{
+		if (!seekable && !presized)
+		{
+			ddp_put(w, head, ar->header.file_offset);
+			ddp_put(w, spool, pos - ar->header.file_offset);
+		}
+		params->filesize = pos + 4;
+		ddp_put(w, (unit8 *)&params->filesize, 4);
+		ddp_flush(w);
+		ret = w->err;
+		if (ret == DDP_OK && seekable && !ddp_pwrite(w, head, ar->header.file_offset, 0))
+			ret = DDP_ERR_WRITE;
+	}
+	free(spool);
+	free(head);
+	ddp_free_aligned(w->buf);
+	return ret;
+}
+
+//outname已经存在并且与ar是同一个文件(包括不同写法的路径和链接)时返回非0
+static int ddp_same_file(ddp_archive *ar, const char *outname)
+{
+#ifdef _WIN32
+	BY_HANDLE_FILE_INFORMATION a, b;
+	HANDLE h = CreateFileA(outname, 0, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	int same;
+	if (h == INVALID_HANDLE_VALUE)
+		return 0;
+	same = GetFileInformationByHandle(h, &a) && GetFileInformationByHandle(ar->file, &b) && a.dwVolumeSerialNumber == b.dwVolumeSerialNumber
+		&& a.nFileIndexHigh == b.nFileIndexHigh && a.nFileIndexLow == b.nFileIndexLow;
+	CloseHandle(h);
+	return same;
+#else
+	struct stat a, b;
+	return stat(outname, &a) == 0 && fstat(ar->fd, &b) == 0 && a.st_dev == b.st_dev && a.st_ino == b.st_ino;
+#endif
+}
+
+int ddp_write_archive(ddp_archive *ar, const char *outname, struct ddp_write_params *params)
+{
+	struct ddp_writer w;
+	int ret;
+	w.sink = NULL;
+	//打开输出时会截断文件，ar还映射着它
+	if (ddp_same_file(ar, outname))
+		return DDP_ERR_SAME_FILE;
+#ifdef _WIN32
+	w.file = CreateFileA(outname, GENERIC_READ | GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);//去重时要读回已写出的数据
+	if (w.file == INVALID_HANDLE_VALUE)
+		return DDP_ERR_OPEN;
+	ret = ddp_write(ar, &w, 1, params);
+	CloseHandle(w.file);
+#else
+	w.fd = open(outname, O_RDWR | O_CREAT | O_TRUNC, 0644);
+	if (w.fd < 0)
+		return DDP_ERR_OPEN;
+	ret = ddp_write(ar, &w, 1, params);
+	if (close(w.fd) != 0 && ret == DDP_OK)
+		ret = DDP_ERR_WRITE;
+#endif
+	return ret;
+}
+
+int ddp_write_archive_to(ddp_archive *ar, ddp_sink_fn sink, void *sink_ctx, struct ddp_write_params *params)
+{
+	struct ddp_writer w;
+	w.sink = sink;
+	w.ctx = sink_ctx;
+	return ddp_write(ar, &w, 0, params);
+}
+
+//把head中的索引记录重新读进ar的索引数组
+static void ddp_reload_index(ddp_archive *ar, const unit8 *head)
+{
+	unit32 i, pos;
+	memcpy(ar->head, head, ar->header.file_offset);
+	for (i = 0; i < ar->count; i++)
+	{
+		pos = ar->record != NULL ? ar->record[i] + 1 : 0x20 + i * 0x10;
+		memcpy(&ar->offset[i], head + pos, 4);
+		memcpy(&ar->uncomprlen[i], head + pos + 4, 4);
+		memcpy(&ar->comprlen[i], head + pos + 8, 4);
+	}
+}
+
+//修补失败时把文件截断回原来的大小，去掉追加的数据和新的文件大小记录，截断成功后再写回原来的索引表和文件大小记录
+static int ddp_patch_rollback(struct ddp_writer *w, ddp_archive *ar)
+{
+#ifdef _WIN32
+	LARGE_INTEGER size;
+	size.QuadPart = ar->size;
+	if (!SetFilePointerEx(w->file, size, NULL, FILE_BEGIN) || !SetEndOfFile(w->file))
+		return 0;
+#else
+	if (ftruncate(w->fd, ar->size) != 0)
+		return 0;
+#endif
+	return ddp_pwrite(w, ar->head, ar->header.file_offset, 0) && ddp_pwrite(w, (const unit8 *)&ar->header.filesize, 4, ar->size - 4);
+}
+
+int ddp_patch_archive(ddp_archive *ar, const char *fname, struct ddp_write_params *params)
+{
+	struct ddp_writer w;
+	struct ddp_entry e;
+	ddp_bufpool *bufs;
+	struct ddp_cctx *cctx = ddp_cctx_create();
+	unit8 *head, *data, *cdata, *out;
+	unit32 i, size, pos = ar->size, changed = 0, maxlen, maxclen;
+	unsigned long long t;
+	int ret = DDP_OK, keep;
+	w.sink = NULL;
+#ifdef _WIN32
+	w.file = CreateFileA(fname, GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_WRITE, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (w.file == INVALID_HANDLE_VALUE)
+		return DDP_ERR_OPEN;
+	if (SetFilePointer(w.file, 0, NULL, FILE_END) != ar->size)
+	{
+		CloseHandle(w.file);
+		return DDP_ERR_FORMAT;
+	}
+#else
+	w.fd = open(fname, O_WRONLY);
+	if (w.fd < 0)
+		return DDP_ERR_OPEN;
+	if (lseek(w.fd, 0, SEEK_END) != (off_t)ar->size)
+	{
+		close(w.fd);
+		return DDP_ERR_FORMAT;
+	}
+#endif
+	head = malloc(ar->header.file_offset);
+	w.buf = ddp_alloc_aligned(DDP_WRITE_BUF, DDP_WRITE_ALIGN);
+	w.used = 0;
+	w.err = DDP_OK;
+	ddp_max_lengths(ar, &maxlen, &maxclen);
+	bufs = ddp_bufpool_create(ddp_cdata_size(maxlen, params->level));
+	if (head == NULL || w.buf == NULL || bufs == NULL)
+		ret = DDP_ERR_NOMEM;
+	else
+		memcpy(head, ar->head, ar->header.file_offset);
+	//新数据追加在原文件末尾(原来的文件大小记录成为废弃的4字节)，索引表最后一次写回，中途失败时截断回原来的大小
+	for (i = 0; i < ar->count && ret == DDP_OK; i++)
+	{
+		keep = 0;
+		if (params->keep != NULL)
+		{
+			t = ddp_stats_now(params->stats);
+			keep = params->keep(params->ctx, ar, i);
+			ddp_stats_stage(params->stats, DDP_STAGE_KEEP, i, t);
+		}
+		if (keep)
+		{
+			if (params->done != NULL)
+				params->done(params->ctx, i, NULL, ddp_get_entry(ar, i, &e));
+			continue;
+		}
+		ret = ddp_pack_entry(ar, params, bufs, cctx, head, i, pos, &e, &data, &cdata, &out);
+		if (ret != DDP_OK)
+		{
+			ddp_bufpool_put(bufs, cdata);
+			break;
+		}
+		size = e.comprlen != 0 ? e.comprlen : e.uncomprlen;
+		t = ddp_stats_now(params->stats);
+		if ((unsigned long long)pos + size + 4 > 0xFFFFFFFF)
+			ret = DDP_ERR_WRITE;
+		else
+			ddp_put(&w, out, size);
+		ddp_stats_stage(params->stats, DDP_STAGE_OUTPUT, i, t);
+		ddp_bufpool_put(bufs, cdata);
+		pos += size;
+		changed++;
+		ddp_entry_done(params, i, data, &e);
+		if (w.err != DDP_OK)
+			ret = w.err;
+	}
+	if (ret == DDP_OK && changed == 0)
+		params->filesize = ar->header.filesize;//没有改动的条目，原封包不动
+	else if (ret == DDP_OK)
+	{
+		params->filesize = pos + 4;
+		ddp_put(&w, (unit8 *)&params->filesize, 4);
+		ddp_flush(&w);
+		ret = w.err;
+		if (ret == DDP_OK && !ddp_pwrite(&w, head, ar->header.file_offset, 0))
+			ret = DDP_ERR_WRITE;
+		if (ret == DDP_OK)
+		{
+			ddp_reload_index(ar, head);
+			ar->header.filesize = params->filesize;
+		}
+	}
+	if (ret != DDP_OK && changed != 0)
+	{
+		w.used = 0;//写缓冲中没写出的数据不要了
+		ddp_patch_rollback(&w, ar);
+	}
+	free(head);
+	ddp_bufpool_free(bufs);
+	ddp_cctx_free(cctx);
+	if (w.buf != NULL)
+		ddp_free_aligned(w.buf);
+#ifdef _WIN32
+	CloseHandle(w.file);
+#else
+	if (close(w.fd) != 0 && ret == DDP_OK)
+		ret = DDP_ERR_WRITE;
+#endif
+	return ret;
+}
+
+static int ddp_keep_all(void *ctx, ddp_archive *ar, unit32 i)
+{
+	(void)ctx;
+	(void)ar;
+	(void)i;
+	return 1;
+}
+
+int ddp_compact_archive(const char *fname, unit32 *saved)
+{
+	ddp_archive *ar;
+	struct ddp_write_params params;
+	char *tmp;
+	unit32 oldsize;
+	int ret;
+	ar = ddp_open(fname, &ret);
+	if (ar == NULL)
+		return ret;
+	tmp = malloc(strlen(fname) + 9);
+	if (tmp == NULL)
+	{
+		ddp_close(ar);
+		return DDP_ERR_NOMEM;
+	}
+	sprintf(tmp, "%s.compact", fname);
+	memset(&params, 0, sizeof(params));
+	params.keep = ddp_keep_all;
+	params.dedup = 1;//原封包中共用的数据区仍然只保留一份
+	oldsize = ar->size;
+	ret = ddp_write_archive(ar, tmp, &params);
+	ddp_close(ar);
+	if (ret == DDP_OK)
+	{
+#ifdef _WIN32
+		if (!MoveFileExA(tmp, fname, MOVEFILE_REPLACE_EXISTING))
+#else
+		if (rename(tmp, fname) != 0)
+#endif
+			ret = DDP_ERR_WRITE;
+	}
+	if (ret != DDP_OK)
+		remove(tmp);
+	else if (saved != NULL)
+		*saved = oldsize - params.filesize;
+	free(tmp);
+	return ret;
+}